@@ -5,10 +5,12 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
 #define TABLE_MAX_PAGES 100
+#define SEGMENT_MAX_PAGES 1024
 #define COLUMN_USERNAME_SIZE 32
 #define COLUMN_EMAIL_SIZE 255
 
@@ -32,6 +34,33 @@ typedef enum {
 	STATEMENT_SELECT
 } StatementType;
 
+typedef enum {
+	COLUMN_ID,
+	COLUMN_USERNAME,
+	COLUMN_EMAIL
+} Column;
+
+#define NUM_COLUMNS 3
+
+typedef enum {
+	COMPARE_EQUAL,
+	COMPARE_LESS,
+	COMPARE_GREATER
+} CompareOp;
+
+/*
+ * LAYOUT_ROWS appends whole rows to a log of pages with no size limit.
+ * LAYOUT_COLUMNS keeps each column in a page stream of its own, <file>.id,
+ * <file>.username and <file>.email, and the table file holds the row count
+ * and a zone map: the min and max value on every column page, so a filtered
+ * scan can skip pages without reading them. It holds at most
+ * columns_max_rows() rows.
+*/
+typedef enum {
+	LAYOUT_ROWS,
+	LAYOUT_COLUMNS
+} Layout;
+
 typedef enum {
 	EXECUTE_SUCCESS,
 	EXECUTE_TABLE_FULL
@@ -49,20 +78,58 @@ typedef struct {
 	char email[COLUMN_EMAIL_SIZE + 1];
 } Row;
 
+/*
+ * A select prints every column unless all_columns is false, in which case it
+ * prints projection only. With has_filter set, only rows whose filter_column
+ * compares to that column of filter_value by op are printed.
+*/
 typedef struct {
 	StatementType type;
 	Row row_to_insert;
+	bool all_columns;
+	Column projection;
+	bool has_filter;
+	Column filter_column;
+	CompareOp op;
+	Row filter_value;
 } Statement;
 
 typedef struct {
 	int file_descriptor;
 	uint32_t file_length;
+	uint32_t pages_read;
 	void* pages[TABLE_MAX_PAGES];
 } Pager;
 
+/*
+ * The row layout's append log. Its pages are split over segment files of
+ * SEGMENT_MAX_PAGES pages each: <file>, then <file>.1, <file>.2 and so on.
+ * Every page starts with its row count, and only the last page, tail, may
+ * hold fewer than ROWS_PER_PAGE rows. tail is mapped, so appends write
+ * straight into it; earlier pages are only ever read.
+*/
+typedef struct {
+	char* filename;
+	int* segment_fds;
+	uint32_t num_segments;
+	uint32_t num_pages;
+	void* tail;
+	uint32_t pages_read;
+} AppendLog;
+
+/*
+ * In LAYOUT_ROWS, append_log holds the rows and pager is unused.
+ * In LAYOUT_COLUMNS, pager holds the table file, only read and written
+ * whole by db_open and db_close, and columns holds the column streams.
+ * zones[column] holds a min then a max value for each of its pages.
+*/
 typedef struct {
 	Pager* pager;
+	AppendLog* append_log;
 	uint32_t num_rows;
+	Layout layout;
+	Pager* columns[NUM_COLUMNS];
+	uint8_t* zones[NUM_COLUMNS];
 } Table;
 
 const uint32_t ID_SIZE = size_of_attribute(Row, id);
@@ -73,8 +140,77 @@ const uint32_t USERNAME_OFFSET = ID_OFFSET + ID_SIZE;
 const uint32_t EMAIL_OFFSET = USERNAME_OFFSET + USERNAME_SIZE;
 const uint32_t ROW_SIZE = ID_SIZE + USERNAME_SIZE + EMAIL_SIZE;
 const uint32_t PAGE_SIZE = 4096;
-const uint32_t ROWS_PER_PAGE = PAGE_SIZE / ROW_SIZE;
-const uint32_t TABLE_MAX_ROWS = ROWS_PER_PAGE * TABLE_MAX_PAGES;
+const uint32_t LOG_PAGE_HEADER_SIZE = sizeof(uint32_t);
+const uint32_t ROWS_PER_PAGE = (PAGE_SIZE - LOG_PAGE_HEADER_SIZE) / ROW_SIZE;
+
+const uint32_t COLUMNS_MAGIC = 0x534c4f43;
+const uint32_t COLUMNS_HEADER_SIZE = 2 * sizeof(uint32_t);
+
+const char* column_names[] = {"id", "username", "email"};
+
+uint32_t column_size(Column column) {
+	switch (column) {
+		case (COLUMN_ID):
+			return ID_SIZE;
+		case (COLUMN_USERNAME):
+			return USERNAME_SIZE;
+		case (COLUMN_EMAIL):
+			return EMAIL_SIZE;
+	}
+	return 0;
+}
+
+uint32_t column_values_per_page(Column column) {
+	return PAGE_SIZE / column_size(column);
+}
+
+uint32_t column_num_pages(Column column, uint32_t num_rows) {
+	uint32_t per_page = column_values_per_page(column);
+	return (num_rows + per_page - 1) / per_page;
+}
+
+/*
+ * The widest column fills its pages first, so it sets the columnar row limit.
+ * Column streams are held whole by their pagers and written at close, so
+ * unlike the row layout's append log they stay within TABLE_MAX_PAGES.
+*/
+uint32_t columns_max_rows() {
+	return column_values_per_page(COLUMN_EMAIL) * TABLE_MAX_PAGES;
+}
+
+void* row_column(Row* row, Column column) {
+	switch (column) {
+		case (COLUMN_ID):
+			return &(row->id);
+		case (COLUMN_USERNAME):
+			return row->username;
+		case (COLUMN_EMAIL):
+			return row->email;
+	}
+	return NULL;
+}
+
+int compare_column_values(Column column, const void* a, const void* b) {
+	if (column == COLUMN_ID) {
+		uint32_t x, y;
+		memcpy(&x, a, ID_SIZE);
+		memcpy(&y, b, ID_SIZE);
+		return (x > y) - (x < y);
+	}
+	return strcmp(a, b);
+}
+
+bool compare_matches(CompareOp op, int compared) {
+	switch (op) {
+		case (COMPARE_EQUAL):
+			return compared == 0;
+		case (COMPARE_LESS):
+			return compared < 0;
+		case (COMPARE_GREATER):
+			return compared > 0;
+	}
+	return false;
+}
 
 InputBuffer* new_input_buffer() {
 	InputBuffer* input_buffer = (InputBuffer*)malloc(sizeof(InputBuffer));
@@ -103,6 +239,7 @@ Pager* pager_open(const char* filename) {
 	Pager* pager = malloc(sizeof(Pager));
 	pager->file_descriptor = fd;
 	pager->file_length = file_length;
+	pager->pages_read = 0;
 
 	for (uint32_t i = 0; i < TABLE_MAX_PAGES; i++) {
 		pager->pages[i] = NULL;
@@ -111,13 +248,248 @@ Pager* pager_open(const char* filename) {
 	return pager;
 }
 
-Table* db_open(const char* filename) {
-	Pager* pager = pager_open(filename);
-	uint32_t num_rows = pager->file_length / ROW_SIZE;
+void column_filename(const char* filename, Column column, char* path) {
+	snprintf(path, FILENAME_MAX, "%s.%s", filename, column_names[column]);
+}
+
+uint32_t* log_page_num_rows(void* page) {
+	return page;
+}
+
+void* log_page_row(void* page, uint32_t row_num) {
+	return page + LOG_PAGE_HEADER_SIZE + row_num * ROW_SIZE;
+}
+
+int segment_open(const char* filename, uint32_t segment, int flags) {
+	char path[FILENAME_MAX];
+	if (segment == 0) {
+		snprintf(path, FILENAME_MAX, "%s", filename);
+	} else {
+		snprintf(path, FILENAME_MAX, "%s.%d", filename, segment);
+	}
+	return open(path, flags, S_IWUSR | S_IRUSR);
+}
+
+void log_unmap_tail(AppendLog* append_log) {
+	if (append_log->tail != NULL && munmap(append_log->tail, PAGE_SIZE) == -1) {
+		printf("Error unmapping page: %d\n", errno);
+		exit(EXIT_FAILURE);
+	}
+	append_log->tail = NULL;
+}
+
+void log_map_tail(AppendLog* append_log) {
+	uint32_t page_num = append_log->num_pages - 1;
+	int fd = append_log->segment_fds[page_num / SEGMENT_MAX_PAGES];
+	off_t offset = (off_t)(page_num % SEGMENT_MAX_PAGES) * PAGE_SIZE;
+
+	void* tail = mmap(NULL, PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, offset);
+	if (tail == MAP_FAILED) {
+		printf("Error mapping page: %d\n", errno);
+		exit(EXIT_FAILURE);
+	}
+	append_log->tail = tail;
+}
+
+/*
+ * Opens every segment there is. All but the last must be full, and the
+ * last must end on a page boundary.
+*/
+AppendLog* log_open(const char* filename) {
+	int fd = segment_open(filename, 0, O_RDWR | O_CREAT);
+	if (fd == -1) {
+		printf("Unable to open file\n");
+		exit(EXIT_FAILURE);
+	}
+
+	AppendLog* append_log = malloc(sizeof(AppendLog));
+	append_log->filename = strdup(filename);
+	append_log->segment_fds = NULL;
+	append_log->num_segments = 0;
+	append_log->num_pages = 0;
+	append_log->tail = NULL;
+	append_log->pages_read = 0;
+
+	while (fd != -1) {
+		off_t file_length = lseek(fd, 0, SEEK_END);
+		uint32_t segment = append_log->num_segments;
+		if (file_length % PAGE_SIZE != 0 || append_log->num_pages != segment * SEGMENT_MAX_PAGES
+				|| file_length / PAGE_SIZE > SEGMENT_MAX_PAGES) {
+			printf("Db file is not a whole number of pages. Corrupt file.\n");
+			exit(EXIT_FAILURE);
+		}
+
+		append_log->segment_fds = realloc(append_log->segment_fds, (segment + 1) * sizeof(int));
+		append_log->segment_fds[segment] = fd;
+		append_log->num_segments += 1;
+		append_log->num_pages += file_length / PAGE_SIZE;
+		fd = segment_open(filename, append_log->num_segments, O_RDWR);
+	}
+
+	if (append_log->num_pages > 0) {
+		log_map_tail(append_log);
+	}
+	return append_log;
+}
+
+uint32_t log_num_rows(AppendLog* append_log) {
+	if (append_log->num_pages == 0) {
+		return 0;
+	}
+	return (append_log->num_pages - 1) * ROWS_PER_PAGE + *log_page_num_rows(append_log->tail);
+}
+
+/* Adds an empty page past the tail, starting a new segment if the last is full. */
+void log_extend(AppendLog* append_log) {
+	uint32_t page_num = append_log->num_pages;
+	uint32_t segment = page_num / SEGMENT_MAX_PAGES;
+
+	if (segment == append_log->num_segments) {
+		int fd = segment_open(append_log->filename, segment, O_RDWR | O_CREAT);
+		if (fd == -1) {
+			printf("Unable to open file\n");
+			exit(EXIT_FAILURE);
+		}
+		append_log->segment_fds = realloc(append_log->segment_fds, (segment + 1) * sizeof(int));
+		append_log->segment_fds[segment] = fd;
+		append_log->num_segments += 1;
+	}
+
+	off_t length = (off_t)(page_num % SEGMENT_MAX_PAGES + 1) * PAGE_SIZE;
+	if (ftruncate(append_log->segment_fds[segment], length) == -1) {
+		printf("Error writing: %d\n", errno);
+		exit(EXIT_FAILURE);
+	}
+
+	log_unmap_tail(append_log);
+	append_log->num_pages += 1;
+	log_map_tail(append_log);
+}
+
+/*
+ * Returns page page_num: the mapped tail itself, or an earlier page read
+ * into buffer.
+*/
+void* log_page(AppendLog* append_log, uint32_t page_num, void* buffer) {
+	if (page_num == append_log->num_pages - 1) {
+		return append_log->tail;
+	}
+
+	int fd = append_log->segment_fds[page_num / SEGMENT_MAX_PAGES];
+	off_t offset = (off_t)(page_num % SEGMENT_MAX_PAGES) * PAGE_SIZE;
+	if (pread(fd, buffer, PAGE_SIZE, offset) != (ssize_t)PAGE_SIZE) {
+		printf("Error reading file: %d\n", errno);
+		exit(EXIT_FAILURE);
+	}
+	append_log->pages_read += 1;
+	return buffer;
+}
+
+void log_close(AppendLog* append_log) {
+	log_unmap_tail(append_log);
+	for (uint32_t i = 0; i < append_log->num_segments; i++) {
+		if (close(append_log->segment_fds[i]) == -1) {
+			printf("Error closing db file.\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+	free(append_log->segment_fds);
+	free(append_log->filename);
+	free(append_log);
+}
+
+uint8_t* zone_min(Table* table, Column column, uint32_t page_num) {
+	return table->zones[column] + page_num * 2 * column_size(column);
+}
+
+uint8_t* zone_max(Table* table, Column column, uint32_t page_num) {
+	return zone_min(table, column, page_num) + column_size(column);
+}
+
+/*
+ * Table file in LAYOUT_COLUMNS: magic, row count, then for each column in
+ * order, the min and max of each of its pages in use.
+*/
+void read_zone_maps(Table* table) {
+	Pager* pager = table->pager;
+	uint32_t header[2];
+	ssize_t bytes_read = pread(pager->file_descriptor, header, COLUMNS_HEADER_SIZE, 0);
+	if (bytes_read != (ssize_t)COLUMNS_HEADER_SIZE || header[0] != COLUMNS_MAGIC) {
+		printf("Table file has no column header. Corrupt file.\n");
+		exit(EXIT_FAILURE);
+	}
+	table->num_rows = header[1];
+
+	off_t offset = COLUMNS_HEADER_SIZE;
+	for (Column column = COLUMN_ID; column < NUM_COLUMNS; column++) {
+		uint32_t length = column_num_pages(column, table->num_rows) * 2 * column_size(column);
+		if (pread(pager->file_descriptor, table->zones[column], length, offset) != (ssize_t)length) {
+			printf("Error reading file: %d\n", errno);
+			exit(EXIT_FAILURE);
+		}
+		offset += length;
+	}
+}
+
+void write_zone_maps(Table* table) {
+	Pager* pager = table->pager;
+	uint32_t header[2] = {COLUMNS_MAGIC, table->num_rows};
+	if (pwrite(pager->file_descriptor, header, COLUMNS_HEADER_SIZE, 0) == -1) {
+		printf("Error writing: %d\n", errno);
+		exit(EXIT_FAILURE);
+	}
+
+	off_t offset = COLUMNS_HEADER_SIZE;
+	for (Column column = COLUMN_ID; column < NUM_COLUMNS; column++) {
+		uint32_t length = column_num_pages(column, table->num_rows) * 2 * column_size(column);
+		if (pwrite(pager->file_descriptor, table->zones[column], length, offset) == -1) {
+			printf("Error writing: %d\n", errno);
+			exit(EXIT_FAILURE);
+		}
+		offset += length;
+	}
+}
+
+/*
+ * An existing table keeps the layout it was created with, found by whether
+ * its column streams exist; layout only applies to a new one.
+*/
+Table* db_open(const char* filename, Layout layout) {
+	char path[FILENAME_MAX];
+	column_filename(filename, COLUMN_ID, path);
+	bool has_columns = access(path, F_OK) == 0;
+	struct stat file_stat;
+	bool has_rows = !has_columns && stat(filename, &file_stat) == 0 && file_stat.st_size > 0;
+
+	if (has_rows && layout == LAYOUT_COLUMNS) {
+		printf("Table was created with row layout.\n");
+		exit(EXIT_FAILURE);
+	}
+	if (has_rows || has_columns) {
+		layout = has_columns ? LAYOUT_COLUMNS : LAYOUT_ROWS;
+	}
 
 	Table* table = (Table*)malloc(sizeof(Table));
-	table->pager = pager;
-	table->num_rows = num_rows;
+	table->pager = NULL;
+	table->append_log = NULL;
+	table->layout = layout;
+
+	if (layout == LAYOUT_ROWS) {
+		table->append_log = log_open(filename);
+		table->num_rows = log_num_rows(table->append_log);
+		return table;
+	}
+
+	table->pager = pager_open(filename);
+	for (Column column = COLUMN_ID; column < NUM_COLUMNS; column++) {
+		column_filename(filename, column, path);
+		table->columns[column] = pager_open(path);
+		table->zones[column] = malloc(TABLE_MAX_PAGES * 2 * column_size(column));
+	}
+	table->num_rows = 0;
+	if (table->pager->file_length > 0) {
+		read_zone_maps(table);
+	}
 
 	return table;
 }
@@ -143,29 +515,7 @@ void pager_flush(Pager* pager, uint32_t page_num, uint32_t size) {
 	}
 }
 
-void db_close(Table* table) {
-	Pager* pager = table->pager;
-	uint32_t num_full_pages = table->num_rows / ROWS_PER_PAGE;
-
-	for (uint32_t i = 0; i < num_full_pages; i++) {
-		if (pager->pages[i] == NULL) {
-			continue;
-		}
-		pager_flush(pager, i, PAGE_SIZE);
-		free(pager->pages[i]);
-		pager->pages[i] = NULL;
-	}
-
-	uint32_t num_additional_rows = table->num_rows % ROWS_PER_PAGE;
-	if (num_additional_rows > 0) {
-		uint32_t page_num = num_full_pages;
-		if (pager->pages[page_num] != NULL) {
-			pager_flush(pager, page_num, num_additional_rows * ROW_SIZE);
-			free(pager->pages[page_num]);
-			pager->pages[page_num] = NULL;
-		}
-	}
-
+void pager_close(Pager* pager) {
 	int result = close(pager->file_descriptor);
 	if (result == -1) {
 		printf("Error closing db file.\n");
@@ -179,6 +529,34 @@ void db_close(Table* table) {
 		}
 	}
 	free(pager);
+}
+
+/* Column pages are always written whole; the row count in the table file bounds them. */
+void columns_close(Table* table) {
+	write_zone_maps(table);
+	for (Column column = COLUMN_ID; column < NUM_COLUMNS; column++) {
+		Pager* pager = table->columns[column];
+		uint32_t num_pages = column_num_pages(column, table->num_rows);
+		for (uint32_t i = 0; i < num_pages; i++) {
+			if (pager->pages[i] != NULL) {
+				pager_flush(pager, i, PAGE_SIZE);
+			}
+		}
+		pager_close(pager);
+		free(table->zones[column]);
+	}
+
+	pager_close(table->pager);
+	free(table);
+}
+
+void db_close(Table* table) {
+	if (table->layout == LAYOUT_COLUMNS) {
+		columns_close(table);
+		return;
+	}
+
+	log_close(table->append_log);
 	free(table);
 }
 
@@ -231,6 +609,9 @@ void* get_page(Pager* pager, uint32_t page_num) {
 				printf("Error reading file: %d\n", errno);
 				exit(EXIT_FAILURE);
 			}
+			if (bytes_read > 0) {
+				pager->pages_read += 1;
+			}
 		}
 
 		pager->pages[page_num] = page;
@@ -239,18 +620,52 @@ void* get_page(Pager* pager, uint32_t page_num) {
 	return pager->pages[page_num];
 }
 
-void* row_slot(Table* table, uint32_t row_num) {
-	uint32_t page_num = row_num / ROWS_PER_PAGE;
-	void* page = get_page(table->pager, page_num);
-	uint32_t row_offset = row_num % ROWS_PER_PAGE;
-	uint32_t byte_offset = row_offset * ROW_SIZE;
-	return page + byte_offset;
+/*
+ * Appends count rows, filling the tail and extending the log as it fills.
+ * Rows are written before the page's row count covers them, and the count
+ * is bumped once per page rather than once per row.
+*/
+void log_append(AppendLog* append_log, Row* rows, uint32_t count) {
+	uint32_t appended = 0;
+	while (appended < count) {
+		if (append_log->tail == NULL || *log_page_num_rows(append_log->tail) == ROWS_PER_PAGE) {
+			log_extend(append_log);
+		}
+
+		uint32_t* num_rows = log_page_num_rows(append_log->tail);
+		uint32_t room = ROWS_PER_PAGE - *num_rows;
+		uint32_t batch = count - appended < room ? count - appended : room;
+		for (uint32_t i = 0; i < batch; i++) {
+			serialize_row(&rows[appended + i], log_page_row(append_log->tail, *num_rows + i));
+		}
+		*num_rows += batch;
+		appended += batch;
+	}
+}
+
+void* column_slot(Table* table, Column column, uint32_t row_num) {
+	uint32_t per_page = column_values_per_page(column);
+	void* page = get_page(table->columns[column], row_num / per_page);
+	return page + (row_num % per_page) * column_size(column);
+}
+
+void print_stats(Table* table) {
+	if (table->layout == LAYOUT_ROWS) {
+		printf("pages_read %d\n", table->append_log->pages_read);
+		return;
+	}
+	for (Column column = COLUMN_ID; column < NUM_COLUMNS; column++) {
+		printf("%s_pages_read %d\n", column_names[column], table->columns[column]->pages_read);
+	}
 }
 
 MetaCommandResult do_meta_command(InputBuffer* input_buffer, Table* table){
 	if (strcmp(input_buffer->buffer, ".exit") == 0) {
 		db_close(table);
 		exit(EXIT_SUCCESS);
+	} else if (strcmp(input_buffer->buffer, ".stats") == 0) {
+		print_stats(table);
+		return META_COMMAND_SUCCESS;
 	} else {
 		return META_COMMAND_UNRECOGNIZED_COMMAND;
 	}
@@ -259,7 +674,7 @@ MetaCommandResult do_meta_command(InputBuffer* input_buffer, Table* table){
 PrepareResult prepare_insert(InputBuffer* input_buffer, Statement* statement) {
 	statement->type = STATEMENT_INSERT;
 	
-	char* keyword = strtok(input_buffer->buffer, " ");
+	strtok(input_buffer->buffer, " ");
 	char* id_string = strtok(NULL, " ");
 	char* username = strtok(NULL, " ");
 	char* email = strtok(NULL, " ");
@@ -286,40 +701,207 @@ PrepareResult prepare_insert(InputBuffer* input_buffer, Statement* statement) {
 	return PREPARE_SUCCESS;
 }
 
+bool parse_column(const char* name, Column* column) {
+	for (Column candidate = COLUMN_ID; candidate < NUM_COLUMNS; candidate++) {
+		if (strcmp(name, column_names[candidate]) == 0) {
+			*column = candidate;
+			return true;
+		}
+	}
+	return false;
+}
+
+/* select [column] [where column =|<|> value] */
+PrepareResult prepare_select(InputBuffer* input_buffer, Statement* statement) {
+	statement->type = STATEMENT_SELECT;
+	statement->all_columns = true;
+	statement->has_filter = false;
+	statement->filter_column = COLUMN_ID;
+
+	strtok(input_buffer->buffer, " ");
+	char* token = strtok(NULL, " ");
+	if (token != NULL && strcmp(token, "where") != 0) {
+		if (!parse_column(token, &statement->projection)) {
+			return PREPARE_SYNTAX_ERROR;
+		}
+		statement->all_columns = false;
+		token = strtok(NULL, " ");
+	}
+	if (token == NULL) {
+		return PREPARE_SUCCESS;
+	}
+
+	char* column = strtok(NULL, " ");
+	char* op = strtok(NULL, " ");
+	char* value = strtok(NULL, " ");
+	if (strcmp(token, "where") != 0 || column == NULL || op == NULL || value == NULL || strtok(NULL, " ") != NULL) {
+		return PREPARE_SYNTAX_ERROR;
+	}
+	if (!parse_column(column, &statement->filter_column)) {
+		return PREPARE_SYNTAX_ERROR;
+	}
+
+	if (strcmp(op, "=") == 0) {
+		statement->op = COMPARE_EQUAL;
+	} else if (strcmp(op, "<") == 0) {
+		statement->op = COMPARE_LESS;
+	} else if (strcmp(op, ">") == 0) {
+		statement->op = COMPARE_GREATER;
+	} else {
+		return PREPARE_SYNTAX_ERROR;
+	}
+
+	Row* filter_value = &(statement->filter_value);
+	if (statement->filter_column == COLUMN_ID) {
+		int id = atoi(value);
+		if (id < 0) {
+			return PREPARE_NEGATIVE_ID;
+		}
+		filter_value->id = id;
+	} else {
+		if (strlen(value) >= column_size(statement->filter_column)) {
+			return PREPARE_STRING_TOO_LONG;
+		}
+		strcpy(row_column(filter_value, statement->filter_column), value);
+	}
+
+	statement->has_filter = true;
+	return PREPARE_SUCCESS;
+}
+
 PrepareResult prepare_statement(InputBuffer* input_buffer, Statement* statement) {
 	if (strncmp(input_buffer->buffer, "insert", 6) == 0) {
 		return prepare_insert(input_buffer, statement);
 	}
-	if (strcmp(input_buffer->buffer, "select") == 0) {
-		statement->type = STATEMENT_SELECT;
-		return PREPARE_SUCCESS;
+	if (strncmp(input_buffer->buffer, "select", 6) == 0) {
+		return prepare_select(input_buffer, statement);
 	}
 
 	return PREPARE_UNRECOGNIZED_COMMAND;
 }
 
-ExecuteResult execute_insert(Statement* statement, Table* table) {
-	if (table->num_rows >= TABLE_MAX_ROWS) {
-		return EXECUTE_TABLE_FULL;
+/* Writes each column's value and widens the zone of the page it lands on. */
+void insert_columns(Table* table, Row* row) {
+	uint32_t row_num = table->num_rows;
+	for (Column column = COLUMN_ID; column < NUM_COLUMNS; column++) {
+		void* value = row_column(row, column);
+		uint32_t size = column_size(column);
+		uint32_t page_num = row_num / column_values_per_page(column);
+		bool first_on_page = row_num % column_values_per_page(column) == 0;
+
+		memcpy(column_slot(table, column, row_num), value, size);
+		if (first_on_page || compare_column_values(column, value, zone_min(table, column, page_num)) < 0) {
+			memcpy(zone_min(table, column, page_num), value, size);
+		}
+		if (first_on_page || compare_column_values(column, value, zone_max(table, column, page_num)) > 0) {
+			memcpy(zone_max(table, column, page_num), value, size);
+		}
 	}
+}
 
+ExecuteResult execute_insert(Statement* statement, Table* table) {
 	Row* row_to_insert = &(statement->row_to_insert);
 
-	serialize_row(row_to_insert, row_slot(table, table->num_rows));
+	if (table->layout == LAYOUT_COLUMNS) {
+		if (table->num_rows >= columns_max_rows()) {
+			return EXECUTE_TABLE_FULL;
+		}
+		insert_columns(table, row_to_insert);
+	} else {
+		log_append(table->append_log, row_to_insert, 1);
+	}
 	table->num_rows += 1;
 
 	return EXECUTE_SUCCESS;
 }
 
-ExecuteResult execute_select(Statement* statement, Table* table) {
+void print_row(Statement* statement, Row* row) {
+	if (statement->all_columns) {
+		printf("(%d, %s, %s)\n", row->id, row->username, row->email);
+	} else if (statement->projection == COLUMN_ID) {
+		printf("(%d)\n", row->id);
+	} else {
+		printf("(%s)\n", (char*)row_column(row, statement->projection));
+	}
+}
+
+/* False if no value on the page can satisfy the filter. */
+bool zone_may_match(Table* table, Statement* statement, uint32_t page_num) {
+	Column column = statement->filter_column;
+	void* value = row_column(&(statement->filter_value), column);
+	void* min = zone_min(table, column, page_num);
+	void* max = zone_max(table, column, page_num);
+
+	switch (statement->op) {
+		case (COMPARE_EQUAL):
+			return compare_column_values(column, value, min) >= 0 && compare_column_values(column, value, max) <= 0;
+		case (COMPARE_LESS):
+			return compare_column_values(column, min, value) < 0;
+		case (COMPARE_GREATER):
+			return compare_column_values(column, max, value) > 0;
+	}
+	return true;
+}
+
+/*
+ * Reads the filter column page by page, skipping pages its zone map rules
+ * out, and reads the printed columns only for rows that match. Columns that
+ * are neither filtered nor printed are never read.
+*/
+ExecuteResult execute_select_columns(Statement* statement, Table* table) {
+	Column filter_column = statement->filter_column;
 	Row row;
+
 	for (uint32_t i = 0; i < table->num_rows; i++) {
-		deserialize_row(row_slot(table, i), &row);
-		printf("(%d, %s, %s)\n", row.id, row.username, row.email);
+		if (statement->has_filter) {
+			uint32_t per_page = column_values_per_page(filter_column);
+			if (i % per_page == 0 && !zone_may_match(table, statement, i / per_page)) {
+				i += per_page - 1;
+				continue;
+			}
+			void* value = column_slot(table, filter_column, i);
+			if (!compare_matches(statement->op, compare_column_values(filter_column, value, row_column(&(statement->filter_value), filter_column)))) {
+				continue;
+			}
+		}
+
+		for (Column column = COLUMN_ID; column < NUM_COLUMNS; column++) {
+			if (statement->all_columns || statement->projection == column) {
+				memcpy(row_column(&row, column), column_slot(table, column, i), column_size(column));
+			}
+		}
+		print_row(statement, &row);
 	}
 	return EXECUTE_SUCCESS;
 }
 
+ExecuteResult execute_select(Statement* statement, Table* table) {
+	if (table->layout == LAYOUT_COLUMNS) {
+		return execute_select_columns(statement, table);
+	}
+
+	AppendLog* append_log = table->append_log;
+	void* buffer = malloc(PAGE_SIZE);
+	Row row;
+	for (uint32_t page_num = 0; page_num < append_log->num_pages; page_num++) {
+		void* page = log_page(append_log, page_num, buffer);
+		uint32_t num_rows = *log_page_num_rows(page);
+		for (uint32_t i = 0; i < num_rows; i++) {
+			deserialize_row(log_page_row(page, i), &row);
+			if (statement->has_filter) {
+				Column column = statement->filter_column;
+				int compared = compare_column_values(column, row_column(&row, column), row_column(&(statement->filter_value), column));
+				if (!compare_matches(statement->op, compared)) {
+					continue;
+				}
+			}
+			print_row(statement, &row);
+		}
+	}
+	free(buffer);
+	return EXECUTE_SUCCESS;
+}
+
 ExecuteResult execute_statement(Statement* statement, Table* table) {
 	switch (statement->type) {
 		case (STATEMENT_INSERT):
@@ -327,6 +909,9 @@ ExecuteResult execute_statement(Statement* statement, Table* table) {
 		case (STATEMENT_SELECT):
 			return execute_select(statement, table);
 	}
+
+	printf("Unknown statement type %d\n", statement->type);
+	exit(EXIT_FAILURE);
 }
 
 int main(int argc, char* argv[]){
@@ -337,7 +922,16 @@ int main(int argc, char* argv[]){
 	}
 
 	char* filename = argv[1];
-	Table* table = db_open(filename);
+	Layout layout = LAYOUT_ROWS;
+	for (int i = 2; i < argc; i++) {
+		if (strcmp(argv[i], "--columnar") == 0) {
+			layout = LAYOUT_COLUMNS;
+		} else {
+			printf("Unrecognized option '%s'.\n", argv[i]);
+			exit(EXIT_FAILURE);
+		}
+	}
+	Table* table = db_open(filename, layout);
 
 	InputBuffer* input_buffer = new_input_buffer();
 	while (true) {
@@ -377,7 +971,7 @@ int main(int argc, char* argv[]){
 				printf("Executed.\n");
 				break;
 			case (EXECUTE_TABLE_FULL):
-				printf("Error: Table full.\n");
+				printf("Error: Table full. The columnar layout holds at most %d rows.\n", columns_max_rows());
 				break;
 		}
 	}
@@ -0,0 +1,442 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../table.h"
+#include "../node.h"
+#include "../vector.h"
+#include "../btree.h"
+#include "../cache.h"
+#include "../hash.h"
+#include "../lsm.h"
+
+/*
+ * Engine micro-benchmarks. Every result is printed as one JSON object per
+ * line so runs can be diffed or loaded into a regression tracker.
+*/
+
+#define BENCH_FILENAME "bench.db"
+#define BENCH_HASH_FILENAME "bench_hash.db"
+#define BENCH_LSM_FILENAME "bench_lsm.db"
+#define BENCH_LOOKUPS 10000
+#define BENCH_SCANS 20
+#define BENCH_RANGE_SCANS 2000
+#define BENCH_RANGE_LENGTH 100
+#define BENCH_REOPENS 20
+#define BENCH_ROW_CACHE_SLOTS 256
+#define BENCH_LSM_MEMTABLE_ROWS 128
+
+typedef struct {
+	uint64_t* samples;
+	uint32_t num_samples;
+	uint64_t total_ns;
+	uint64_t ops;
+} BenchResult;
+
+static uint64_t now_ns() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int compare_u64(const void* a, const void* b) {
+	uint64_t x = *(const uint64_t*)a;
+	uint64_t y = *(const uint64_t*)b;
+	return (x > y) - (x < y);
+}
+
+static BenchResult* result_new(uint32_t max_samples) {
+	BenchResult* result = malloc(sizeof(BenchResult));
+	result->samples = malloc(max_samples * sizeof(uint64_t));
+	result->num_samples = 0;
+	result->total_ns = 0;
+	result->ops = 0;
+	return result;
+}
+
+static void result_record(BenchResult* result, uint64_t elapsed_ns, uint64_t ops) {
+	result->samples[result->num_samples++] = elapsed_ns;
+	result->total_ns += elapsed_ns;
+	result->ops += ops;
+}
+
+static void result_report(BenchResult* result, const char* name, const char* mode, uint32_t rows) {
+	qsort(result->samples, result->num_samples, sizeof(uint64_t), compare_u64);
+	uint64_t p50 = result->samples[result->num_samples / 2];
+	uint64_t p99 = result->samples[(uint64_t)result->num_samples * 99 / 100];
+	double seconds = result->total_ns / 1e9;
+
+	printf("{\"benchmark\":\"%s\",\"mode\":\"%s\",\"rows\":%u,\"ops\":%llu,"
+		"\"seconds\":%.6f,\"ops_per_sec\":%.1f,\"p50_ns\":%llu,\"p99_ns\":%llu}\n",
+		name, mode, rows, (unsigned long long)result->ops, seconds,
+		seconds > 0 ? result->ops / seconds : 0.0,
+		(unsigned long long)p50, (unsigned long long)p99);
+	fflush(stdout);
+
+	free(result->samples);
+	free(result);
+}
+
+static void make_row(Row* row, uint32_t id) {
+	row->id = id;
+	snprintf(row->username, sizeof(row->username), "user%u", id);
+	snprintf(row->email, sizeof(row->email), "user%u@example.com", id);
+}
+
+static void shuffle(uint32_t* keys, uint32_t count) {
+	for (uint32_t i = count - 1; i > 0; i--) {
+		uint32_t j = rand() % (i + 1);
+		uint32_t tmp = keys[i];
+		keys[i] = keys[j];
+		keys[j] = tmp;
+	}
+}
+
+static Cursor* find_id(Table* table, uint32_t id, Key* key) {
+	key_from_uint64(key, id);
+	return table_find(table, key);
+}
+
+static Table* bench_insert(const char* name, PagerMode mode, const char* mode_name, uint32_t* keys, uint32_t rows) {
+	unlink(BENCH_FILENAME);
+	Table* table = db_open_mode(BENCH_FILENAME, mode);
+	BenchResult* result = result_new(rows);
+	Row row;
+	Key key;
+
+	for (uint32_t i = 0; i < rows; i++) {
+		make_row(&row, keys[i]);
+		uint64_t start = now_ns();
+		Cursor* cursor = find_id(table, keys[i], &key);
+		if (!cursor_at_key(cursor, &key)) {
+			leaf_node_insert(cursor, &key, &row);
+		}
+		free(cursor);
+		result_record(result, now_ns() - start, 1);
+	}
+
+	result_report(result, name, mode_name, rows);
+	return table;
+}
+
+static void bench_lookups(Table* table, const char* mode_name, uint32_t rows) {
+	BenchResult* result = result_new(BENCH_LOOKUPS);
+	uint32_t found = 0;
+	Key key;
+
+	for (uint32_t i = 0; i < BENCH_LOOKUPS; i++) {
+		uint32_t id = 1 + rand() % rows;
+		uint64_t start = now_ns();
+		Cursor* cursor = find_id(table, id, &key);
+		found += cursor_at_key(cursor, &key);
+		free(cursor);
+		result_record(result, now_ns() - start, 1);
+	}
+
+	if (found != BENCH_LOOKUPS) {
+		printf("Point lookups found %u of %u keys\n", found, BENCH_LOOKUPS);
+		exit(EXIT_FAILURE);
+	}
+	result_report(result, "point_lookup", mode_name, rows);
+}
+
+/*
+ * db_get where 1% of ids take 90% of reads, without and then with a row
+ * cache attached.
+*/
+static void bench_skewed_lookups(Table* table, const char* mode_name, uint32_t rows) {
+	uint32_t hot_rows = rows / 100 > 0 ? rows / 100 : 1;
+	const char* names[] = {"point_lookup_skewed", "point_lookup_skewed_cached"};
+
+	for (uint32_t pass = 0; pass < 2; pass++) {
+		if (pass == 1) {
+			table->row_cache = row_cache_new(BENCH_ROW_CACHE_SLOTS);
+		}
+
+		BenchResult* result = result_new(BENCH_LOOKUPS);
+		Row row;
+		for (uint32_t i = 0; i < BENCH_LOOKUPS; i++) {
+			uint32_t id = rand() % 10 < 9 ? 1 + rand() % hot_rows : 1 + rand() % rows;
+			uint64_t start = now_ns();
+			DbResult found = db_get(table, id, &row);
+			result_record(result, now_ns() - start, 1);
+
+			if (found != DB_OK || row.id != id) {
+				printf("Skewed lookup missed key %u\n", id);
+				exit(EXIT_FAILURE);
+			}
+		}
+		result_report(result, names[pass], mode_name, rows);
+	}
+
+	row_cache_free(table->row_cache);
+	table->row_cache = NULL;
+}
+
+/*
+ * The same random inserts and point lookups as insert_random and
+ * point_lookup, against an extendible-hash table.
+*/
+static void bench_hash(PagerMode mode, const char* mode_name, uint32_t* keys, uint32_t rows) {
+	unlink(BENCH_HASH_FILENAME);
+	Table* table = hash_open_mode(BENCH_HASH_FILENAME, mode);
+	BenchResult* result = result_new(rows);
+	Row row;
+
+	for (uint32_t i = 0; i < rows; i++) {
+		make_row(&row, keys[i]);
+		uint64_t start = now_ns();
+		hash_put(table, &row);
+		result_record(result, now_ns() - start, 1);
+	}
+	result_report(result, "hash_insert_random", mode_name, rows);
+
+	result = result_new(BENCH_LOOKUPS);
+	for (uint32_t i = 0; i < BENCH_LOOKUPS; i++) {
+		uint32_t id = 1 + rand() % rows;
+		uint64_t start = now_ns();
+		DbResult found = hash_get(table, id, &row);
+		result_record(result, now_ns() - start, 1);
+
+		if (found != DB_OK || row.id != id) {
+			printf("Hash lookup missed key %u\n", id);
+			exit(EXIT_FAILURE);
+		}
+	}
+	result_report(result, "hash_point_lookup", mode_name, rows);
+
+	db_close(table);
+	unlink(BENCH_HASH_FILENAME);
+}
+
+/*
+ * Random-key ingest into the LSM engine, with a memtable small enough that
+ * the run flushes and compacts, then point lookups and a merged full scan
+ * once the worker is idle. The LSM has no pager, so it runs once per size.
+*/
+static void bench_lsm(uint32_t rows) {
+	uint32_t* keys = malloc(rows * sizeof(uint32_t));
+	for (uint32_t i = 0; i < rows; i++) {
+		keys[i] = i + 1;
+	}
+	shuffle(keys, rows);
+
+	lsm_destroy(BENCH_LSM_FILENAME);
+	Lsm* lsm = lsm_open(BENCH_LSM_FILENAME, BENCH_LSM_MEMTABLE_ROWS);
+	BenchResult* result = result_new(rows);
+	Row row;
+
+	for (uint32_t i = 0; i < rows; i++) {
+		make_row(&row, keys[i]);
+		uint64_t start = now_ns();
+		lsm_put(lsm, &row);
+		result_record(result, now_ns() - start, 1);
+	}
+	result_report(result, "lsm_insert_random", "lsm", rows);
+	lsm_wait_idle(lsm);
+
+	result = result_new(BENCH_LOOKUPS);
+	for (uint32_t i = 0; i < BENCH_LOOKUPS; i++) {
+		uint32_t id = 1 + rand() % rows;
+		uint64_t start = now_ns();
+		DbResult found = lsm_get(lsm, id, &row);
+		result_record(result, now_ns() - start, 1);
+
+		if (found != DB_OK || row.id != id) {
+			printf("LSM lookup missed key %u\n", id);
+			exit(EXIT_FAILURE);
+		}
+	}
+	result_report(result, "lsm_point_lookup", "lsm", rows);
+
+	result = result_new(BENCH_SCANS);
+	for (uint32_t i = 0; i < BENCH_SCANS; i++) {
+		uint32_t seen = 0;
+		uint64_t start = now_ns();
+		LsmIterator* iterator = lsm_scan(lsm, 0, UINT64_MAX);
+		while (lsm_iterator_next(iterator, &row)) {
+			seen++;
+		}
+		lsm_iterator_close(iterator);
+		result_record(result, now_ns() - start, seen);
+
+		if (seen != rows) {
+			printf("LSM scan saw %u of %u rows\n", seen, rows);
+			exit(EXIT_FAILURE);
+		}
+	}
+	result_report(result, "lsm_full_scan", "lsm", rows);
+
+	lsm_close(lsm);
+	lsm_destroy(BENCH_LSM_FILENAME);
+	free(keys);
+}
+
+static void bench_full_scan(Table* table, const char* mode_name, uint32_t rows) {
+	BenchResult* result = result_new(BENCH_SCANS);
+	Row row;
+
+	for (uint32_t i = 0; i < BENCH_SCANS; i++) {
+		uint32_t seen = 0;
+		uint64_t start = now_ns();
+		Cursor* cursor = table_start(table);
+		while (!cursor->end_of_table) {
+			deserialize_row(cursor_value(cursor), &row);
+			seen++;
+			cursor_advance(cursor);
+		}
+		free(cursor);
+		result_record(result, now_ns() - start, seen);
+
+		if (seen != rows) {
+			printf("Full scan saw %u of %u rows\n", seen, rows);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	result_report(result, "full_scan", mode_name, rows);
+}
+
+/*
+ * count(*) where username >= "user5", once row at a time through a cursor
+ * and once through the batch kernels.
+*/
+static void bench_filtered_count(Table* table, const char* mode_name, uint32_t rows) {
+	const char* bound = "user5";
+	BenchResult* cursor_result = result_new(BENCH_SCANS);
+	BenchResult* vector_result = result_new(BENCH_SCANS);
+	RowBatch* batch = malloc(sizeof(RowBatch));
+
+	for (uint32_t i = 0; i < BENCH_SCANS; i++) {
+		uint32_t cursor_count = 0;
+		uint64_t start = now_ns();
+		Cursor* cursor = table_start(table);
+		while (!cursor->end_of_table) {
+			Row row;
+			deserialize_row(cursor_value(cursor), &row);
+			cursor_count += strcmp(row.username, bound) >= 0;
+			cursor_advance(cursor);
+		}
+		free(cursor);
+		result_record(cursor_result, now_ns() - start, rows);
+
+		uint32_t vector_count_total = 0;
+		start = now_ns();
+		VectorScan scan;
+		vector_scan_open(&scan, table, 0, UINT32_MAX);
+		while (vector_scan_next(&scan, batch)) {
+			vector_filter_text(batch, COLUMN_USERNAME, COMPARE_GREATER_EQUAL, bound);
+			vector_count_total += vector_count(batch);
+		}
+		vector_scan_close(&scan);
+		result_record(vector_result, now_ns() - start, rows);
+
+		if (cursor_count != vector_count_total) {
+			printf("Filtered count mismatch: cursor %u, vector %u\n", cursor_count, vector_count_total);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	free(batch);
+	result_report(cursor_result, "filtered_count_cursor", mode_name, rows);
+	result_report(vector_result, "filtered_count_vector", mode_name, rows);
+}
+
+static void bench_range_scan(Table* table, const char* mode_name, uint32_t rows) {
+	BenchResult* result = result_new(BENCH_RANGE_SCANS);
+	Row row;
+	Key key;
+
+	for (uint32_t i = 0; i < BENCH_RANGE_SCANS; i++) {
+		uint32_t start_id = 1 + rand() % rows;
+		uint32_t seen = 0;
+		uint64_t start = now_ns();
+		Cursor* cursor = find_id(table, start_id, &key);
+		while (!cursor->end_of_table && seen < BENCH_RANGE_LENGTH) {
+			deserialize_row(cursor_value(cursor), &row);
+			seen++;
+			cursor_advance(cursor);
+		}
+		free(cursor);
+		result_record(result, now_ns() - start, seen);
+	}
+
+	result_report(result, "range_scan", mode_name, rows);
+}
+
+static void bench_reopen(PagerMode mode, const char* mode_name, uint32_t rows) {
+	BenchResult* result = result_new(BENCH_REOPENS);
+
+	Key key;
+
+	for (uint32_t i = 0; i < BENCH_REOPENS; i++) {
+		uint32_t id = 1 + rand() % rows;
+		uint64_t start = now_ns();
+		Table* table = db_open_mode(BENCH_FILENAME, mode);
+		Cursor* cursor = find_id(table, id, &key);
+		bool found = cursor_at_key(cursor, &key);
+		free(cursor);
+		result_record(result, now_ns() - start, 1);
+		db_close(table);
+
+		if (!found) {
+			printf("Reopened table is missing key %u\n", id);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	result_report(result, "reopen", mode_name, rows);
+}
+
+static void bench_size(PagerMode mode, const char* mode_name, uint32_t rows) {
+	uint32_t* keys = malloc(rows * sizeof(uint32_t));
+	for (uint32_t i = 0; i < rows; i++) {
+		keys[i] = i + 1;
+	}
+
+	Table* table = bench_insert("insert_sequential", mode, mode_name, keys, rows);
+	db_close(table);
+
+	shuffle(keys, rows);
+	table = bench_insert("insert_random", mode, mode_name, keys, rows);
+	bench_lookups(table, mode_name, rows);
+	bench_hash(mode, mode_name, keys, rows);
+	bench_skewed_lookups(table, mode_name, rows);
+	bench_full_scan(table, mode_name, rows);
+	bench_filtered_count(table, mode_name, rows);
+	bench_range_scan(table, mode_name, rows);
+	db_close(table);
+
+	bench_reopen(mode, mode_name, rows);
+
+	unlink(BENCH_FILENAME);
+	free(keys);
+}
+
+int main(int argc, char* argv[]) {
+	uint32_t default_sizes[] = {500, 1000, 2000};
+	uint32_t num_sizes = sizeof(default_sizes) / sizeof(default_sizes[0]);
+	uint32_t* sizes = default_sizes;
+
+	if (argc > 1) {
+		num_sizes = argc - 1;
+		sizes = malloc(num_sizes * sizeof(uint32_t));
+		for (uint32_t i = 0; i < num_sizes; i++) {
+			sizes[i] = atoi(argv[i + 1]);
+		}
+	}
+
+	srand(42);
+	for (uint32_t i = 0; i < num_sizes; i++) {
+		bench_size(PAGER_IN_PLACE, "in_place", sizes[i]);
+		bench_size(PAGER_COPY_ON_WRITE, "copy_on_write", sizes[i]);
+		bench_size(PAGER_COMPRESSED, "compressed", sizes[i]);
+		bench_lsm(sizes[i]);
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,190 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "table.h"
+#include "node.h"
+#include "bloom.h"
+#include "stats.h"
+
+static uint32_t* bloom_num_pages(void* header) {
+	return header + BLOOM_NUM_PAGES_OFFSET;
+}
+
+static uint32_t* bloom_num_keys(void* header) {
+	return header + BLOOM_NUM_KEYS_OFFSET;
+}
+
+static uint32_t* bloom_page(void* header, uint32_t page_index) {
+	return header + BLOOM_PAGES_OFFSET + page_index * sizeof(uint32_t);
+}
+
+bool bloom_exists(Table* table) {
+	return table->bloom_page_num != 0;
+}
+
+static uint32_t bloom_capacity(uint32_t num_pages) {
+	return num_pages * PAGE_SIZE * 8 / BLOOM_BITS_PER_KEY;
+}
+
+static uint32_t bloom_pages_for(uint32_t num_keys) {
+	uint32_t bits_per_page = PAGE_SIZE * 8;
+	uint32_t num_pages = (num_keys * BLOOM_BITS_PER_KEY + bits_per_page - 1) / bits_per_page;
+	if (num_pages == 0) {
+		return 1;
+	}
+	return num_pages < BLOOM_MAX_PAGES ? num_pages : BLOOM_MAX_PAGES;
+}
+
+/* splitmix64's finalizer: sequential ids spread over every block. */
+static uint64_t bloom_hash(uint64_t id) {
+	id ^= id >> 30;
+	id *= 0xbf58476d1ce4e5b9ull;
+	id ^= id >> 27;
+	id *= 0x94d049bb133111ebull;
+	id ^= id >> 31;
+	return id;
+}
+
+/*
+ * The low half of the hash picks the block. Probes within it step through
+ * the block's bits by an odd stride taken from the high half.
+*/
+static uint8_t* bloom_block(Pager* pager, void* header, uint64_t hash, bool write) {
+	uint32_t blocks_per_page = PAGE_SIZE / BLOOM_BLOCK_SIZE;
+	uint32_t num_blocks = *bloom_num_pages(header) * blocks_per_page;
+	uint32_t block = ((hash & UINT32_MAX) * num_blocks) >> 32;
+
+	uint32_t page_num = *bloom_page(header, block / blocks_per_page);
+	uint8_t* page = write ? get_page(pager, page_num) : peek_page(pager, page_num);
+	return page + (block % blocks_per_page) * BLOOM_BLOCK_SIZE;
+}
+
+static uint32_t bloom_probe(uint64_t hash, uint32_t probe) {
+	uint32_t start = hash >> 32;
+	uint32_t stride = (hash >> 48) | 1;
+	return (start + probe * stride) % (BLOOM_BLOCK_SIZE * 8);
+}
+
+static void bloom_set(Pager* pager, void* header, uint64_t id) {
+	uint64_t hash = bloom_hash(id);
+	uint8_t* block = bloom_block(pager, header, hash, true);
+	for (uint32_t i = 0; i < BLOOM_PROBES; i++) {
+		uint32_t bit = bloom_probe(hash, i);
+		block[bit / 8] |= 1 << (bit % 8);
+	}
+	*bloom_num_keys(header) += 1;
+}
+
+/*
+ * Grows the filter to num_pages bit pages, keeping the pages it already
+ * has, clears them, and adds every id in the table. The leaves are read
+ * with peek_page, so inside a write only the filter's pages join the
+ * write set.
+*/
+static void bloom_rebuild(Table* table, void* header, uint32_t num_pages) {
+	Pager* pager = table->pager;
+	for (uint32_t i = *bloom_num_pages(header); i < num_pages; i++) {
+		uint32_t page_num = get_unused_page_num(pager);
+		get_page(pager, page_num);
+		*bloom_page(header, i) = page_num;
+	}
+	if (num_pages > *bloom_num_pages(header)) {
+		*bloom_num_pages(header) = num_pages;
+	}
+
+	for (uint32_t i = 0; i < *bloom_num_pages(header); i++) {
+		memset(get_page(pager, *bloom_page(header, i)), 0, PAGE_SIZE);
+	}
+	*bloom_num_keys(header) = 0;
+
+	uint32_t page_num = table->root_page_num;
+	void* node = peek_page(pager, page_num);
+	while (get_node_type(node) == NODE_INTERNAL) {
+		page_num = *internal_node_child(node, 0);
+		node = peek_page(pager, page_num);
+	}
+
+	while (true) {
+		uint32_t num_cells = *leaf_node_num_cells(node);
+		for (uint32_t i = 0; i < num_cells; i++) {
+			if (*leaf_node_txn(node, i) == LEAF_NODE_DELETED_TXN) {
+				continue;
+			}
+			uint64_t id;
+			memcpy(&id, leaf_node_value(node, i) + ID_OFFSET, ID_SIZE);
+			bloom_set(pager, header, id);
+		}
+
+		page_num = *leaf_node_next_leaf(node);
+		if (page_num == 0) {
+			break;
+		}
+		node = peek_page(pager, page_num);
+	}
+}
+
+/*
+ * Creates the filter over the rows already in the table, sized for twice
+ * as many, or rebuilds the existing one.
+*/
+void bloom_create(Table* table) {
+	Pager* pager = table->pager;
+	table_begin_write(table);
+
+	uint32_t* slot = get_page(pager, 0) + CATALOG_BLOOM_OFFSET;
+	if (*slot == 0) {
+		uint32_t header_page_num = get_unused_page_num(pager);
+		void* header = get_page(pager, header_page_num);
+		memset(header, 0, PAGE_SIZE);
+		*slot = header_page_num;
+	}
+
+	table->bloom_page_num = *slot;
+	void* header = get_page(pager, *slot);
+	bloom_rebuild(table, header, bloom_pages_for(2 * table_count(table)));
+
+	table_commit(table);
+}
+
+/* False only if id was never added. True whenever there is no filter. */
+bool bloom_may_contain(Table* table, uint64_t id) {
+	uint32_t header_page_num = table->bloom_page_num;
+	if (header_page_num == 0) {
+		return true;
+	}
+
+	void* header = peek_page(table->pager, header_page_num);
+	uint64_t hash = bloom_hash(id);
+	uint8_t* block = bloom_block(table->pager, header, hash, false);
+	for (uint32_t i = 0; i < BLOOM_PROBES; i++) {
+		uint32_t bit = bloom_probe(hash, i);
+		if ((block[bit / 8] & (1 << (bit % 8))) == 0) {
+			stats_add(STAT_BLOOM_NEGATIVES, 1);
+			return false;
+		}
+	}
+	return true;
+}
+
+/*
+ * Adds an id that has just been inserted into the table, inside the
+ * insert's transaction. A full filter is doubled and rebuilt instead,
+ * which picks the id up from the table.
+*/
+void bloom_add(Table* table, uint64_t id) {
+	uint32_t header_page_num = table->bloom_page_num;
+	if (header_page_num == 0) {
+		return;
+	}
+
+	void* header = get_page(table->pager, header_page_num);
+	uint32_t num_pages = *bloom_num_pages(header);
+	if (*bloom_num_keys(header) >= bloom_capacity(num_pages) && num_pages < BLOOM_MAX_PAGES) {
+		bloom_rebuild(table, header, 2 * num_pages < BLOOM_MAX_PAGES ? 2 * num_pages : BLOOM_MAX_PAGES);
+		return;
+	}
+
+	bloom_set(table->pager, header, id);
+}
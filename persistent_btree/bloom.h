@@ -0,0 +1,35 @@
+#ifndef BLOOM_H
+#define BLOOM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "table.h"
+
+/*
+ * Blocked Bloom filter over the table's ids, so a lookup for an id that was
+ * never inserted returns without descending the tree. It is stored in the
+ * file: the catalog names a header page holding the number of bit pages,
+ * the number of ids added, and the bit pages' numbers. Bits are grouped in
+ * BLOOM_BLOCK_SIZE byte blocks and every probe for an id lands in one
+ * block, so a check reads a single bit page. Rows are never deleted, so
+ * bits are never cleared; once the ids added reach the filter's capacity
+ * it doubles its bit pages and is rebuilt from the table.
+*/
+static const uint32_t BLOOM_BITS_PER_KEY = 10;
+static const uint32_t BLOOM_PROBES = 6;
+static const uint32_t BLOOM_BLOCK_SIZE = 64;
+static const uint32_t BLOOM_NUM_PAGES_OFFSET = 0;
+static const uint32_t BLOOM_NUM_KEYS_OFFSET = BLOOM_NUM_PAGES_OFFSET + sizeof(uint32_t);
+static const uint32_t BLOOM_PAGES_OFFSET = BLOOM_NUM_KEYS_OFFSET + sizeof(uint32_t);
+static const uint32_t BLOOM_MAX_PAGES = (PAGE_SIZE - BLOOM_PAGES_OFFSET) / sizeof(uint32_t);
+
+bool bloom_exists(Table* table);
+
+void bloom_create(Table* table);
+
+bool bloom_may_contain(Table* table, uint64_t id);
+
+void bloom_add(Table* table, uint64_t id);
+
+#endif // BLOOM_H
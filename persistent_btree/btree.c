@@ -0,0 +1,152 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "table.h"
+#include "node.h"
+#include "index.h"
+#include "btree.h"
+#include "cache.h"
+#include "bloom.h"
+#include "version.h"
+
+DbResult db_put(Table* table, Row* row) {
+	return indexed_put(table, row, false) == PUT_DUPLICATE ? DB_DUPLICATE_KEY : DB_OK;
+}
+
+/*
+ * Inserts row, or replaces the row with its id. Scans opened before the
+ * upsert keep reading the row as it was until they are closed.
+*/
+DbResult db_upsert(Table* table, Row* row) {
+	indexed_put(table, row, true);
+	return DB_OK;
+}
+
+DbResult db_get(Table* table, uint64_t id, Row* row) {
+	uint8_t value[ROW_SIZE];
+	if (table->row_cache != NULL && row_cache_get(table->row_cache, id, value)) {
+		deserialize_row(value, row);
+		return DB_OK;
+	}
+	if (!bloom_may_contain(table, id)) {
+		return DB_NOT_FOUND;
+	}
+
+	Key key;
+	key_from_uint64(&key, id);
+	Cursor* cursor = table_find(table, &key);
+	DbResult result = DB_NOT_FOUND;
+
+	if (cursor_at_key(cursor, &key)) {
+		void* cell = cursor_value(cursor);
+		if (table->row_cache != NULL) {
+			row_cache_put(table->row_cache, id, cell);
+		}
+		deserialize_row(cell, row);
+		result = DB_OK;
+	}
+
+	free(cursor);
+	return result;
+}
+
+/*
+ * Iterates ids in [start_id, end_id] in key order as of the moment the scan
+ * was opened; puts made while it is open are not returned, and rows upserts
+ * replace are returned as they were. The scan holds its snapshot until
+ * db_iterator_close.
+*/
+DbIterator* db_scan(Table* table, uint64_t start_id, uint64_t end_id) {
+	Key start_key;
+	key_from_uint64(&start_key, start_id);
+	DbIterator* iterator = malloc(sizeof(DbIterator));
+	version_hold_snapshot(table);
+	iterator->cursor = table_seek(table, &start_key);
+	iterator->end_id = end_id;
+	return iterator;
+}
+
+bool db_iterator_next(DbIterator* iterator, Row* row) {
+	Cursor* cursor = iterator->cursor;
+	if (cursor->end_of_table || key_to_uint64(&cursor->key) > iterator->end_id) {
+		return false;
+	}
+
+	deserialize_row(cursor_value(cursor), row);
+	cursor_advance(cursor);
+	return true;
+}
+
+void db_iterator_close(DbIterator* iterator) {
+	indexed_release_snapshot(iterator->cursor->table, iterator->cursor->snapshot_txn);
+	free(iterator->cursor);
+	free(iterator);
+}
+
+DbBatch* db_batch_new() {
+	DbBatch* batch = malloc(sizeof(DbBatch));
+	batch->rows = NULL;
+	batch->num_rows = 0;
+	batch->capacity = 0;
+	return batch;
+}
+
+void db_batch_put(DbBatch* batch, Row* row) {
+	if (batch->num_rows == batch->capacity) {
+		batch->capacity = batch->capacity == 0 ? 64 : batch->capacity * 2;
+		batch->rows = realloc(batch->rows, batch->capacity * sizeof(Row));
+	}
+	batch->rows[batch->num_rows++] = *row;
+}
+
+static int compare_row_ids(const void* a, const void* b) {
+	uint64_t x = ((const Row*)a)->id;
+	uint64_t y = ((const Row*)b)->id;
+	return (x > y) - (x < y);
+}
+
+/*
+ * Applies the whole batch as one transaction, or nothing if any id is
+ * already present or repeated. Rows are inserted in key order so
+ * consecutive puts land on the same, already cached leaf.
+*/
+DbResult db_batch_commit(Table* table, DbBatch* batch) {
+	qsort(batch->rows, batch->num_rows, sizeof(Row), compare_row_ids);
+
+	for (uint32_t i = 0; i < batch->num_rows; i++) {
+		if (i > 0 && batch->rows[i].id == batch->rows[i - 1].id) {
+			return DB_DUPLICATE_KEY;
+		}
+		if (!bloom_may_contain(table, batch->rows[i].id)) {
+			continue;
+		}
+		Key key;
+		key_from_uint64(&key, batch->rows[i].id);
+		Cursor* cursor = table_find(table, &key);
+		bool exists = cursor_at_key(cursor, &key);
+		free(cursor);
+		if (exists) {
+			return DB_DUPLICATE_KEY;
+		}
+	}
+
+	table_begin_write(table);
+	for (uint32_t i = 0; i < batch->num_rows; i++) {
+		Key key;
+		key_from_uint64(&key, batch->rows[i].id);
+		Cursor* cursor = table_find(table, &key);
+		indexed_insert(cursor, &batch->rows[i]);
+		free(cursor);
+	}
+	table_commit(table);
+
+	batch->num_rows = 0;
+	return DB_OK;
+}
+
+void db_batch_free(DbBatch* batch) {
+	free(batch->rows);
+	free(batch);
+}
@@ -0,0 +1,52 @@
+#ifndef BTREE_H
+#define BTREE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "table.h"
+
+/*
+ * Embeddable interface to the engine. Tables come from db_open / db_open_mode
+ * and are released with db_close; everything here works on rows directly and
+ * never formats or parses text. A Table is not safe for concurrent writers.
+*/
+
+typedef enum {
+	DB_OK,
+	DB_NOT_FOUND,
+	DB_DUPLICATE_KEY
+} DbResult;
+
+typedef struct {
+	Cursor* cursor;
+	uint64_t end_id;
+} DbIterator;
+
+typedef struct {
+	Row* rows;
+	uint32_t num_rows;
+	uint32_t capacity;
+} DbBatch;
+
+DbResult db_put(Table* table, Row* row);
+
+DbResult db_upsert(Table* table, Row* row);
+
+DbResult db_get(Table* table, uint64_t id, Row* row);
+
+DbIterator* db_scan(Table* table, uint64_t start_id, uint64_t end_id);
+
+bool db_iterator_next(DbIterator* iterator, Row* row);
+
+void db_iterator_close(DbIterator* iterator);
+
+DbBatch* db_batch_new();
+
+void db_batch_put(DbBatch* batch, Row* row);
+
+DbResult db_batch_commit(Table* table, DbBatch* batch);
+
+void db_batch_free(DbBatch* batch);
+
+#endif // BTREE_H
@@ -0,0 +1,70 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "table.h"
+#include "cache.h"
+#include "stats.h"
+
+/* Capacity is rounded up to a power of two so a slot is the hash's low bits. */
+RowCache* row_cache_new(uint32_t capacity) {
+	uint32_t num_slots = 1;
+	while (num_slots < capacity) {
+		num_slots <<= 1;
+	}
+
+	RowCache* cache = malloc(sizeof(RowCache));
+	cache->entries = calloc(num_slots, sizeof(RowCacheEntry));
+	cache->values = malloc((size_t)num_slots * ROW_SIZE);
+	cache->mask = num_slots - 1;
+	pthread_mutex_init(&cache->lock, NULL);
+	return cache;
+}
+
+/* Fibonacci hashing, so runs of consecutive ids spread across the slots. */
+static uint32_t row_cache_slot(RowCache* cache, uint64_t id) {
+	return (id * 11400714819323198485ull) >> 32 & cache->mask;
+}
+
+/* Copies the cached row for id into value. Returns false on a miss. */
+bool row_cache_get(RowCache* cache, uint64_t id, void* value) {
+	pthread_mutex_lock(&cache->lock);
+	uint32_t slot = row_cache_slot(cache, id);
+	RowCacheEntry* entry = &cache->entries[slot];
+	bool hit = entry->valid && entry->id == id;
+	if (hit) {
+		memcpy(value, cache->values + (size_t)slot * ROW_SIZE, ROW_SIZE);
+	}
+	pthread_mutex_unlock(&cache->lock);
+
+	stats_add(hit ? STAT_ROW_CACHE_HITS : STAT_ROW_CACHE_MISSES, 1);
+	return hit;
+}
+
+void row_cache_put(RowCache* cache, uint64_t id, const void* value) {
+	pthread_mutex_lock(&cache->lock);
+	uint32_t slot = row_cache_slot(cache, id);
+	RowCacheEntry* entry = &cache->entries[slot];
+	entry->id = id;
+	entry->valid = true;
+	memcpy(cache->values + (size_t)slot * ROW_SIZE, value, ROW_SIZE);
+	pthread_mutex_unlock(&cache->lock);
+}
+
+void row_cache_invalidate(RowCache* cache, uint64_t id) {
+	pthread_mutex_lock(&cache->lock);
+	RowCacheEntry* entry = &cache->entries[row_cache_slot(cache, id)];
+	if (entry->id == id) {
+		entry->valid = false;
+	}
+	pthread_mutex_unlock(&cache->lock);
+}
+
+void row_cache_free(RowCache* cache) {
+	pthread_mutex_destroy(&cache->lock);
+	free(cache->entries);
+	free(cache->values);
+	free(cache);
+}
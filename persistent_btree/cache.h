@@ -0,0 +1,40 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "table.h"
+
+/*
+ * Optional cache of whole rows keyed by id, for skewed point reads. It is
+ * direct-mapped: an id hashes to one slot, and a row cached there replaces
+ * whatever the slot held. Rows are stored serialized, as they are in a
+ * leaf, so a hit is one probe and one copy. Every put through
+ * indexed_insert or indexed_put drops the id's slot.
+*/
+typedef struct {
+	uint64_t id;
+	bool valid;
+} RowCacheEntry;
+
+/* Slot i's row is the ROW_SIZE bytes at values + i * ROW_SIZE. */
+struct RowCache {
+	RowCacheEntry* entries;
+	uint8_t* values;
+	uint32_t mask;
+	pthread_mutex_t lock;
+};
+
+RowCache* row_cache_new(uint32_t capacity);
+
+bool row_cache_get(RowCache* cache, uint64_t id, void* value);
+
+void row_cache_put(RowCache* cache, uint64_t id, const void* value);
+
+void row_cache_invalidate(RowCache* cache, uint64_t id);
+
+void row_cache_free(RowCache* cache);
+
+#endif // CACHE_H
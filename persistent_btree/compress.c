@@ -0,0 +1,331 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "table.h"
+#include "node.h"
+#include "compress.h"
+#include "stats.h"
+
+/*
+ * Page codec, in the style of an LZ4 block. The image is a run of sequences,
+ * each a token byte, literals, and a match copied from earlier output. The
+ * token's high nibble is the literal count and its low nibble the match
+ * length minus COMPRESS_MIN_MATCH; a nibble of 15 continues in following
+ * bytes that are added on until one is below 255. A match is preceded by a
+ * 16-bit little-endian distance back into the output. The last sequence has
+ * literals only and ends the image.
+*/
+#define COMPRESS_HASH_BITS 12
+#define COMPRESS_MIN_MATCH 4
+
+static uint32_t read_uint32(const uint8_t* bytes) {
+	uint32_t value;
+	memcpy(&value, bytes, sizeof(value));
+	return value;
+}
+
+static uint32_t hash_sequence(const uint8_t* bytes) {
+	return (read_uint32(bytes) * 2654435761u) >> (32 - COMPRESS_HASH_BITS);
+}
+
+static uint8_t* write_length(uint8_t* out, uint32_t length) {
+	while (length >= 255) {
+		*out++ = 255;
+		length -= 255;
+	}
+	*out++ = length;
+	return out;
+}
+
+static uint8_t* write_sequence(uint8_t* out, const uint8_t* literals, uint32_t num_literals, uint32_t match_length) {
+	uint32_t literal_nibble = num_literals < 15 ? num_literals : 15;
+	uint32_t match_nibble = 0;
+	if (match_length > 0) {
+		match_length -= COMPRESS_MIN_MATCH;
+		match_nibble = match_length < 15 ? match_length : 15;
+	}
+
+	*out++ = (literal_nibble << 4) | match_nibble;
+	if (literal_nibble == 15) {
+		out = write_length(out, num_literals - 15);
+	}
+	memcpy(out, literals, num_literals);
+	return out + num_literals;
+}
+
+/* Compresses one page into out, which must hold COMPRESS_BOUND bytes. Returns the image length. */
+uint32_t compress_page(const void* page, void* out) {
+	const uint8_t* input = page;
+	uint8_t* output = out;
+	uint16_t table[1 << COMPRESS_HASH_BITS];
+	memset(table, 0, sizeof(table));
+
+	uint32_t anchor = 0;
+	uint32_t position = 1;
+	while (position + COMPRESS_MIN_MATCH <= PAGE_SIZE) {
+		uint32_t hash = hash_sequence(input + position);
+		uint32_t candidate = table[hash];
+		table[hash] = position;
+
+		if (position - candidate > UINT16_MAX
+				|| read_uint32(input + candidate) != read_uint32(input + position)) {
+			position++;
+			continue;
+		}
+
+		uint32_t match_length = COMPRESS_MIN_MATCH;
+		while (position + match_length < PAGE_SIZE
+				&& input[candidate + match_length] == input[position + match_length]) {
+			match_length++;
+		}
+
+		output = write_sequence(output, input + anchor, position - anchor, match_length);
+		uint16_t distance = position - candidate;
+		memcpy(output, &distance, sizeof(distance));
+		output += sizeof(distance);
+		if (match_length - COMPRESS_MIN_MATCH >= 15) {
+			output = write_length(output, match_length - COMPRESS_MIN_MATCH - 15);
+		}
+
+		position += match_length;
+		anchor = position;
+	}
+
+	output = write_sequence(output, input + anchor, PAGE_SIZE - anchor, 0);
+	return output - (uint8_t*)out;
+}
+
+static bool read_length(const uint8_t** in, const uint8_t* end, uint32_t* length) {
+	uint8_t byte;
+	do {
+		if (*in >= end) {
+			return false;
+		}
+		byte = *(*in)++;
+		*length += byte;
+	} while (byte == 255);
+	return true;
+}
+
+static void corrupt_image() {
+	printf("Corrupt compressed page.\n");
+	exit(EXIT_FAILURE);
+}
+
+void decompress_page(const void* in, uint32_t length, void* page) {
+	const uint8_t* input = in;
+	const uint8_t* end = input + length;
+	uint8_t* output = page;
+	uint32_t position = 0;
+
+	while (input < end) {
+		uint8_t token = *input++;
+
+		uint32_t num_literals = token >> 4;
+		if (num_literals == 15 && !read_length(&input, end, &num_literals)) {
+			corrupt_image();
+		}
+		if (num_literals > (uint32_t)(end - input) || num_literals > PAGE_SIZE - position) {
+			corrupt_image();
+		}
+		memcpy(output + position, input, num_literals);
+		input += num_literals;
+		position += num_literals;
+
+		if (input == end) {
+			break;
+		}
+
+		uint16_t distance;
+		if (end - input < (ptrdiff_t)sizeof(distance)) {
+			corrupt_image();
+		}
+		memcpy(&distance, input, sizeof(distance));
+		input += sizeof(distance);
+
+		uint32_t match_length = token & 0xf;
+		if (match_length == 15 && !read_length(&input, end, &match_length)) {
+			corrupt_image();
+		}
+		match_length += COMPRESS_MIN_MATCH;
+		if (distance == 0 || distance > position || match_length > PAGE_SIZE - position) {
+			corrupt_image();
+		}
+
+		/* Byte by byte: a match may overlap the bytes it is producing. */
+		for (uint32_t i = 0; i < match_length; i++) {
+			output[position + i] = output[position - distance + i];
+		}
+		position += match_length;
+	}
+
+	if (position != PAGE_SIZE) {
+		corrupt_image();
+	}
+}
+
+static void compressed_read_at(Pager* pager, uint32_t offset, void* data, uint32_t length) {
+	if (lseek(pager->file_descriptor, offset, SEEK_SET) == -1) {
+		printf("Error seeking: %d\n", errno);
+		exit(EXIT_FAILURE);
+	}
+
+	ssize_t bytes_read = read(pager->file_descriptor, data, length);
+	if (bytes_read != (ssize_t)length) {
+		printf("Error reading file: %d\n", errno);
+		exit(EXIT_FAILURE);
+	}
+}
+
+static void compressed_write(int file_descriptor, const void* data, uint32_t length) {
+	ssize_t bytes_written = write(file_descriptor, data, length);
+	if (bytes_written != (ssize_t)length) {
+		printf("Error writing: %d\n", errno);
+		exit(EXIT_FAILURE);
+	}
+}
+
+bool compressed_is_compressed_file(int file_descriptor, uint32_t file_length) {
+	if (file_length < COMPRESS_TRAILER_SIZE) {
+		return false;
+	}
+
+	uint32_t trailer[2];
+	lseek(file_descriptor, file_length - COMPRESS_TRAILER_SIZE, SEEK_SET);
+	if (read(file_descriptor, trailer, sizeof(trailer)) != sizeof(trailer)) {
+		return false;
+	}
+
+	uint32_t num_pages = trailer[0];
+	return trailer[1] == COMPRESS_MAGIC && num_pages <= TABLE_MAX_PAGES
+		&& num_pages * COMPRESS_DIRECTORY_ENTRY_SIZE <= file_length - COMPRESS_TRAILER_SIZE;
+}
+
+void compressed_format(Pager* pager) {
+	pager->directory.num_pages = 0;
+	pager->num_pages = 0;
+}
+
+void compressed_open(Pager* pager) {
+	PageDirectory* directory = &pager->directory;
+	uint32_t num_pages;
+	compressed_read_at(pager, pager->file_length - COMPRESS_TRAILER_SIZE, &num_pages, sizeof(num_pages));
+
+	uint32_t directory_length = num_pages * COMPRESS_DIRECTORY_ENTRY_SIZE;
+	uint32_t entries[2 * TABLE_MAX_PAGES];
+	uint32_t data_length = pager->file_length - COMPRESS_TRAILER_SIZE - directory_length;
+	compressed_read_at(pager, data_length, entries, directory_length);
+
+	for (uint32_t i = 0; i < num_pages; i++) {
+		directory->offsets[i] = entries[2 * i];
+		directory->lengths[i] = entries[2 * i + 1];
+		if (directory->lengths[i] > PAGE_SIZE
+				|| directory->offsets[i] + directory->lengths[i] > data_length) {
+			printf("Page directory out of bounds. Corrupt file.\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+	directory->num_pages = num_pages;
+	pager->num_pages = num_pages;
+}
+
+void compressed_read_page(Pager* pager, uint32_t page_num, void* page) {
+	PageDirectory* directory = &pager->directory;
+	if (page_num >= directory->num_pages || directory->lengths[page_num] == 0) {
+		return;
+	}
+
+	uint32_t length = directory->lengths[page_num];
+	stats_add(STAT_PAGE_READS, 1);
+	if (length == PAGE_SIZE) {
+		compressed_read_at(pager, directory->offsets[page_num], page, PAGE_SIZE);
+		return;
+	}
+
+	uint8_t image[PAGE_SIZE];
+	compressed_read_at(pager, directory->offsets[page_num], image, length);
+	decompress_page(image, length, page);
+}
+
+/*
+ * Writes every live image, then the directory and trailer, to <file>.tmp and
+ * renames it over the file once it is synced, so a crash leaves either the
+ * old file or the new one. Changed pages are encoded afresh and the rest
+ * copied as they are. Only leaves are compressed; internal pages are few,
+ * are read on every descent, and their cells are mostly keys and page
+ * numbers. Nothing is written if no page changed.
+*/
+void compressed_close(Pager* pager) {
+	PageDirectory* directory = &pager->directory;
+
+	bool changed = false;
+	for (uint32_t i = 0; i < pager->num_pages; i++) {
+		changed |= pager->pages[i] != NULL && pager->dirty[i];
+	}
+	if (!changed) {
+		return;
+	}
+
+	char path[FILENAME_MAX];
+	snprintf(path, FILENAME_MAX, "%s.tmp", pager->filename);
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, S_IWUSR | S_IRUSR);
+	if (fd == -1) {
+		printf("Unable to open file\n");
+		exit(EXIT_FAILURE);
+	}
+
+	uint32_t entries[2 * TABLE_MAX_PAGES];
+	uint32_t position = 0;
+	for (uint32_t i = 0; i < pager->num_pages; i++) {
+		void* page = pager->pages[i];
+		uint8_t image[COMPRESS_BOUND];
+		const void* data = image;
+		uint32_t length = 0;
+
+		if (page != NULL && pager->dirty[i]) {
+			data = page;
+			length = PAGE_SIZE;
+			if (get_node_type(page) == NODE_LEAF) {
+				uint32_t compressed_length = compress_page(page, image);
+				if (compressed_length < PAGE_SIZE) {
+					data = image;
+					length = compressed_length;
+				}
+			}
+			stats_add(STAT_PAGE_WRITES, 1);
+		} else if (i < directory->num_pages) {
+			length = directory->lengths[i];
+			compressed_read_at(pager, directory->offsets[i], image, length);
+		}
+
+		compressed_write(fd, data, length);
+		directory->offsets[i] = position;
+		directory->lengths[i] = length;
+		entries[2 * i] = position;
+		entries[2 * i + 1] = length;
+		position += length;
+	}
+	directory->num_pages = pager->num_pages;
+
+	uint32_t trailer[2] = {directory->num_pages, COMPRESS_MAGIC};
+	compressed_write(fd, entries, directory->num_pages * COMPRESS_DIRECTORY_ENTRY_SIZE);
+	compressed_write(fd, trailer, sizeof(trailer));
+
+	if (fsync(fd) == -1) {
+		printf("Error syncing: %d\n", errno);
+		exit(EXIT_FAILURE);
+	}
+	close(fd);
+	if (rename(path, pager->filename) == -1) {
+		printf("Error replacing file: %d\n", errno);
+		exit(EXIT_FAILURE);
+	}
+}
@@ -0,0 +1,38 @@
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "table.h"
+
+/*
+ * Compressed file layout: page images packed back to back from offset 0,
+ * each either the codec's output or, where that would not be smaller, the
+ * raw page. A directory of (offset, length) per logical page follows the
+ * images, then the page count and the magic. db_close writes a new file
+ * beside the old one and renames it into place, so the file never holds
+ * replaced images and a crash cannot tear it.
+*/
+static const uint32_t COMPRESS_MAGIC = 0x5a475043;
+static const uint32_t COMPRESS_TRAILER_SIZE = 2 * sizeof(uint32_t);
+static const uint32_t COMPRESS_DIRECTORY_ENTRY_SIZE = 2 * sizeof(uint32_t);
+
+/* Worst case for an incompressible page: one long literal run. */
+static const uint32_t COMPRESS_BOUND = PAGE_SIZE + PAGE_SIZE / 255 + 16;
+
+uint32_t compress_page(const void* page, void* out);
+
+void decompress_page(const void* in, uint32_t length, void* page);
+
+bool compressed_is_compressed_file(int file_descriptor, uint32_t file_length);
+
+void compressed_format(Pager* pager);
+
+void compressed_open(Pager* pager);
+
+void compressed_read_page(Pager* pager, uint32_t page_num, void* page);
+
+void compressed_close(Pager* pager);
+
+#endif // COMPRESS_H
@@ -0,0 +1,217 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+
+#include "table.h"
+#include "cow.h"
+#include "stats.h"
+
+static uint32_t cow_checksum(void* meta_page) {
+	return hash_bytes(meta_page + COW_META_TXN_OFFSET, PAGE_SIZE - COW_META_TXN_OFFSET);
+}
+
+static void cow_read_physical(Pager* pager, uint32_t physical_page_num, void* page) {
+	off_t offset = lseek(pager->file_descriptor, (off_t)physical_page_num * PAGE_SIZE, SEEK_SET);
+	if (offset == -1) {
+		printf("Error seeking: %d\n", errno);
+		exit(EXIT_FAILURE);
+	}
+
+	ssize_t bytes_read = read(pager->file_descriptor, page, PAGE_SIZE);
+	if (bytes_read != PAGE_SIZE) {
+		printf("Error reading file: %d\n", errno);
+		exit(EXIT_FAILURE);
+	}
+	stats_add(STAT_PAGE_READS, 1);
+}
+
+static void cow_write_physical(Pager* pager, uint32_t physical_page_num, void* page) {
+	off_t offset = lseek(pager->file_descriptor, (off_t)physical_page_num * PAGE_SIZE, SEEK_SET);
+	if (offset == -1) {
+		printf("Error seeking: %d\n", errno);
+		exit(EXIT_FAILURE);
+	}
+
+	ssize_t bytes_written = write(pager->file_descriptor, page, PAGE_SIZE);
+	if (bytes_written == -1) {
+		printf("Error writing: %d\n", errno);
+		exit(EXIT_FAILURE);
+	}
+	stats_add(STAT_PAGE_WRITES, 1);
+
+	if ((physical_page_num + 1) * PAGE_SIZE > pager->file_length) {
+		pager->file_length = (physical_page_num + 1) * PAGE_SIZE;
+	}
+}
+
+static void cow_sync(Pager* pager) {
+	if (fsync(pager->file_descriptor) == -1) {
+		printf("Error syncing: %d\n", errno);
+		exit(EXIT_FAILURE);
+	}
+}
+
+static void cow_write_meta(Pager* pager, uint32_t slot) {
+	CowMeta* meta = &pager->meta[slot];
+	uint8_t page[PAGE_SIZE];
+	memset(page, 0, PAGE_SIZE);
+
+	memcpy(page + COW_META_MAGIC_OFFSET, &COW_MAGIC, COW_META_MAGIC_SIZE);
+	memcpy(page + COW_META_TXN_OFFSET, &meta->txn, COW_META_TXN_SIZE);
+	memcpy(page + COW_META_NUM_PAGES_OFFSET, &meta->num_pages, COW_META_NUM_PAGES_SIZE);
+	memcpy(page + COW_META_PAGE_MAP_OFFSET, meta->page_map, meta->num_pages * sizeof(uint32_t));
+
+	uint32_t checksum = cow_checksum(page);
+	memcpy(page + COW_META_CHECKSUM_OFFSET, &checksum, COW_META_CHECKSUM_SIZE);
+
+	cow_write_physical(pager, slot, page);
+}
+
+static bool cow_read_meta(Pager* pager, uint32_t slot) {
+	CowMeta* meta = &pager->meta[slot];
+	meta->txn = 0;
+	meta->num_pages = 0;
+
+	if ((slot + 1) * PAGE_SIZE > pager->file_length) {
+		return false;
+	}
+
+	uint8_t page[PAGE_SIZE];
+	cow_read_physical(pager, slot, page);
+
+	uint32_t magic, checksum;
+	memcpy(&magic, page + COW_META_MAGIC_OFFSET, COW_META_MAGIC_SIZE);
+	memcpy(&checksum, page + COW_META_CHECKSUM_OFFSET, COW_META_CHECKSUM_SIZE);
+	if (magic != COW_MAGIC || checksum != cow_checksum(page)) {
+		return false;
+	}
+
+	uint32_t num_pages;
+	memcpy(&num_pages, page + COW_META_NUM_PAGES_OFFSET, COW_META_NUM_PAGES_SIZE);
+	if (num_pages > TABLE_MAX_PAGES) {
+		return false;
+	}
+
+	memcpy(meta->page_map, page + COW_META_PAGE_MAP_OFFSET, num_pages * sizeof(uint32_t));
+	for (uint32_t i = 0; i < num_pages; i++) {
+		if (meta->page_map[i] < COW_META_PAGES || meta->page_map[i] >= COW_MAX_PHYSICAL_PAGES) {
+			return false;
+		}
+	}
+
+	memcpy(&meta->txn, page + COW_META_TXN_OFFSET, COW_META_TXN_SIZE);
+	meta->num_pages = num_pages;
+	return true;
+}
+
+bool cow_is_cow_file(int file_descriptor, uint32_t file_length) {
+	if (file_length < PAGE_SIZE) {
+		return false;
+	}
+
+	uint32_t magic;
+	lseek(file_descriptor, COW_META_MAGIC_OFFSET, SEEK_SET);
+	if (read(file_descriptor, &magic, sizeof(magic)) != sizeof(magic)) {
+		return false;
+	}
+	return magic == COW_MAGIC;
+}
+
+void cow_format(Pager* pager) {
+	pager->meta[0].txn = 0;
+	pager->meta[0].num_pages = 0;
+	pager->meta[1].txn = 0;
+	pager->meta[1].num_pages = 0;
+	pager->meta_slot = 0;
+
+	cow_write_meta(pager, 0);
+	cow_write_meta(pager, 1);
+	cow_sync(pager);
+	pager->num_pages = 0;
+}
+
+/*
+ * Picks the newest meta page whose checksum holds. A torn write of the meta
+ * being committed leaves the previous one intact, so open always lands on the
+ * last fully synced commit.
+*/
+void cow_open(Pager* pager) {
+	bool valid0 = cow_read_meta(pager, 0);
+	bool valid1 = cow_read_meta(pager, 1);
+
+	if (!valid0 && !valid1) {
+		printf("No valid meta page. Corrupt file.\n");
+		exit(EXIT_FAILURE);
+	}
+
+	if (valid0 && (!valid1 || pager->meta[0].txn >= pager->meta[1].txn)) {
+		pager->meta_slot = 0;
+	} else {
+		pager->meta_slot = 1;
+	}
+	pager->num_pages = pager->meta[pager->meta_slot].num_pages;
+}
+
+void cow_read_page(Pager* pager, uint32_t page_num, void* page) {
+	CowMeta* meta = &pager->meta[pager->meta_slot];
+	if (page_num < meta->num_pages) {
+		cow_read_physical(pager, meta->page_map[page_num], page);
+	}
+}
+
+/*
+ * Writes every page dirtied since the last commit to physical pages that
+ * neither meta refers to, syncs them, then publishes the new page map by
+ * rewriting the older meta slot. Readers of the previous commit keep a
+ * consistent image until the commit after this one.
+*/
+void cow_commit(Pager* pager) {
+	uint32_t current_slot = pager->meta_slot;
+	uint32_t next_slot = 1 - current_slot;
+	CowMeta* current = &pager->meta[current_slot];
+	CowMeta* next = &pager->meta[next_slot];
+
+	bool in_use[COW_MAX_PHYSICAL_PAGES];
+	memset(in_use, 0, sizeof(in_use));
+	for (uint32_t i = 0; i < COW_META_PAGES; i++) {
+		in_use[i] = true;
+	}
+	for (uint32_t slot = 0; slot < 2; slot++) {
+		for (uint32_t i = 0; i < pager->meta[slot].num_pages; i++) {
+			in_use[pager->meta[slot].page_map[i]] = true;
+		}
+	}
+
+	CowMeta committed;
+	committed.txn = current->txn + 1;
+	committed.num_pages = pager->num_pages;
+	memcpy(committed.page_map, current->page_map, current->num_pages * sizeof(uint32_t));
+
+	uint32_t free_page_num = COW_META_PAGES;
+	for (uint32_t i = 0; i < pager->num_pages; i++) {
+		if (!pager->dirty[i] || pager->pages[i] == NULL) {
+			continue;
+		}
+		while (free_page_num < COW_MAX_PHYSICAL_PAGES && in_use[free_page_num]) {
+			free_page_num++;
+		}
+		if (free_page_num == COW_MAX_PHYSICAL_PAGES) {
+			printf("No free physical page for commit.\n");
+			exit(EXIT_FAILURE);
+		}
+		cow_write_physical(pager, free_page_num, pager->pages[i]);
+		committed.page_map[i] = free_page_num;
+		in_use[free_page_num] = true;
+		pager->dirty[i] = false;
+	}
+	cow_sync(pager);
+
+	*next = committed;
+	cow_write_meta(pager, next_slot);
+	cow_sync(pager);
+	pager->meta_slot = next_slot;
+}
@@ -0,0 +1,42 @@
+#ifndef COW_H
+#define COW_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "table.h"
+
+/*
+ * Copy-on-write file layout: physical pages 0 and 1 are meta pages written
+ * alternately; every other page holds a node image referenced from a meta
+ * page's page map. A commit never overwrites a page either meta refers to,
+ * so at worst it needs room for both maps plus a copy of every page.
+*/
+static const uint32_t COW_MAGIC = 0x574f4342;
+static const uint32_t COW_META_PAGES = 2;
+static const uint32_t COW_MAX_PHYSICAL_PAGES = 2 + 3 * TABLE_MAX_PAGES;
+
+/*
+ * Meta Page Layout
+*/
+static const uint32_t COW_META_MAGIC_SIZE = sizeof(uint32_t);
+static const uint32_t COW_META_MAGIC_OFFSET = 0;
+static const uint32_t COW_META_CHECKSUM_SIZE = sizeof(uint32_t);
+static const uint32_t COW_META_CHECKSUM_OFFSET = COW_META_MAGIC_OFFSET + COW_META_MAGIC_SIZE;
+static const uint32_t COW_META_TXN_SIZE = sizeof(uint32_t);
+static const uint32_t COW_META_TXN_OFFSET = COW_META_CHECKSUM_OFFSET + COW_META_CHECKSUM_SIZE;
+static const uint32_t COW_META_NUM_PAGES_SIZE = sizeof(uint32_t);
+static const uint32_t COW_META_NUM_PAGES_OFFSET = COW_META_TXN_OFFSET + COW_META_TXN_SIZE;
+static const uint32_t COW_META_PAGE_MAP_OFFSET = COW_META_NUM_PAGES_OFFSET + COW_META_NUM_PAGES_SIZE;
+
+bool cow_is_cow_file(int file_descriptor, uint32_t file_length);
+
+void cow_format(Pager* pager);
+
+void cow_open(Pager* pager);
+
+void cow_read_page(Pager* pager, uint32_t page_num, void* page);
+
+void cow_commit(Pager* pager);
+
+#endif // COW_H
@@ -0,0 +1,256 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "table.h"
+#include "btree.h"
+#include "hash.h"
+
+static uint32_t* header_magic(void* header) {
+	return header + HASH_MAGIC_OFFSET;
+}
+
+static uint32_t* header_global_depth(void* header) {
+	return header + HASH_GLOBAL_DEPTH_OFFSET;
+}
+
+static uint32_t* header_num_rows(void* header) {
+	return header + HASH_NUM_ROWS_OFFSET;
+}
+
+static uint32_t* header_directory_page(void* header, uint32_t page_index) {
+	return header + HASH_DIRECTORY_PAGES_OFFSET + page_index * sizeof(uint32_t);
+}
+
+static uint32_t* bucket_local_depth(void* bucket) {
+	return bucket + HASH_LOCAL_DEPTH_OFFSET;
+}
+
+static uint32_t* bucket_num_rows(void* bucket) {
+	return bucket + HASH_BUCKET_NUM_ROWS_OFFSET;
+}
+
+static void* bucket_row(void* bucket, uint32_t row_num) {
+	return bucket + HASH_BUCKET_HEADER_SIZE + row_num * ROW_SIZE;
+}
+
+static uint64_t bucket_row_id(void* bucket, uint32_t row_num) {
+	uint64_t id;
+	memcpy(&id, bucket_row(bucket, row_num) + ID_OFFSET, ID_SIZE);
+	return id;
+}
+
+/* splitmix64's finalizer, so sequential ids differ in their low bits. */
+static uint64_t hash_id(uint64_t id) {
+	id ^= id >> 30;
+	id *= 0xbf58476d1ce4e5b9ull;
+	id ^= id >> 27;
+	id *= 0x94d049bb133111ebull;
+	id ^= id >> 31;
+	return id;
+}
+
+bool hash_is_hash_page(void* page) {
+	return *header_magic(page) == HASH_MAGIC;
+}
+
+static uint32_t directory_num_pages(uint32_t global_depth) {
+	return ((1u << global_depth) + HASH_SLOTS_PER_PAGE - 1) / HASH_SLOTS_PER_PAGE;
+}
+
+/* With write set, the directory page joins the write set so the slot can be changed. */
+static uint16_t* directory_slot(Pager* pager, void* header, uint32_t index, bool write) {
+	uint32_t page_num = *header_directory_page(header, index / HASH_SLOTS_PER_PAGE);
+	uint16_t* slots = write ? get_page(pager, page_num) : peek_page(pager, page_num);
+	return slots + index % HASH_SLOTS_PER_PAGE;
+}
+
+static uint32_t directory_lookup(Pager* pager, void* header, uint64_t hash) {
+	uint32_t mask = (1u << *header_global_depth(header)) - 1;
+	return *directory_slot(pager, header, hash & mask, false);
+}
+
+/*
+ * Adds one bit to the global depth. The new upper half of the directory
+ * copies the lower, within the one directory page while it has room and as
+ * copies of every directory page after that.
+*/
+static void directory_double(Pager* pager, void* header) {
+	uint32_t global_depth = *header_global_depth(header);
+	uint32_t num_pages = directory_num_pages(global_depth);
+
+	if (directory_num_pages(global_depth + 1) == num_pages) {
+		uint32_t num_slots = 1u << global_depth;
+		uint16_t* slots = directory_slot(pager, header, 0, true);
+		memcpy(slots + num_slots, slots, num_slots * HASH_DIRECTORY_SLOT_SIZE);
+	} else {
+		for (uint32_t i = 0; i < num_pages; i++) {
+			uint32_t page_num = get_unused_page_num(pager);
+			memcpy(get_page(pager, page_num), peek_page(pager, *header_directory_page(header, i)), PAGE_SIZE);
+			*header_directory_page(header, num_pages + i) = page_num;
+		}
+	}
+
+	*header_global_depth(header) = global_depth + 1;
+}
+
+/* Index of the row with id, or the bucket's row count if it has none. */
+static uint32_t bucket_find(void* bucket, uint64_t id) {
+	uint32_t num_rows = *bucket_num_rows(bucket);
+	for (uint32_t i = 0; i < num_rows; i++) {
+		if (bucket_row_id(bucket, i) == id) {
+			return i;
+		}
+	}
+	return num_rows;
+}
+
+static uint32_t new_bucket(Pager* pager, uint32_t local_depth) {
+	uint32_t page_num = get_unused_page_num(pager);
+	void* bucket = get_page(pager, page_num);
+	*bucket_local_depth(bucket) = local_depth;
+	*bucket_num_rows(bucket) = 0;
+	return page_num;
+}
+
+/*
+ * Splits the bucket hash maps to on its next hash bit: rows with the bit set
+ * move to a new bucket, and every directory slot whose low local_depth + 1
+ * bits select it is repointed there. A bucket that already uses all of the
+ * directory's bits doubles the directory first.
+*/
+static void bucket_split(Pager* pager, void* header, uint64_t hash) {
+	void* bucket = get_page(pager, directory_lookup(pager, header, hash));
+	uint32_t local_depth = *bucket_local_depth(bucket);
+
+	if (local_depth == *header_global_depth(header)) {
+		if (local_depth == HASH_MAX_GLOBAL_DEPTH) {
+			printf("Hash directory is full.\n");
+			exit(EXIT_FAILURE);
+		}
+		directory_double(pager, header);
+	}
+	uint32_t global_depth = *header_global_depth(header);
+
+	uint32_t bit = 1u << local_depth;
+	uint32_t sibling_page_num = new_bucket(pager, local_depth + 1);
+	void* sibling = get_page(pager, sibling_page_num);
+	*bucket_local_depth(bucket) = local_depth + 1;
+
+	uint32_t num_kept = 0;
+	uint32_t num_rows = *bucket_num_rows(bucket);
+	for (uint32_t i = 0; i < num_rows; i++) {
+		if (hash_id(bucket_row_id(bucket, i)) & bit) {
+			memcpy(bucket_row(sibling, (*bucket_num_rows(sibling))++), bucket_row(bucket, i), ROW_SIZE);
+		} else {
+			if (num_kept != i) {
+				memcpy(bucket_row(bucket, num_kept), bucket_row(bucket, i), ROW_SIZE);
+			}
+			num_kept++;
+		}
+	}
+	*bucket_num_rows(bucket) = num_kept;
+
+	for (uint32_t i = (hash & (bit - 1)) | bit; i < (1u << global_depth); i += bit << 1) {
+		*directory_slot(pager, header, i, true) = sibling_page_num;
+	}
+}
+
+Table* hash_open(const char* filename) {
+	return hash_open_mode(filename, PAGER_IN_PLACE);
+}
+
+/*
+ * Opens a hash table, creating it if the file is empty. The Table it returns
+ * is released with db_close; its root page is the header.
+*/
+Table* hash_open_mode(const char* filename, PagerMode mode) {
+	Pager* pager = pager_open(filename, mode);
+
+	Table* table = malloc(sizeof(Table));
+	table->pager = pager;
+	table->root_page_num = 0;
+	table->txn = 0;
+	table->row_cache = NULL;
+	table->bloom_page_num = 0;
+	table->versions = NULL;
+
+	if (pager->num_pages == 0) {
+		pager_begin_write(pager);
+		void* header = get_page(pager, 0);
+		*header_magic(header) = HASH_MAGIC;
+		*header_global_depth(header) = 0;
+		*header_num_rows(header) = 0;
+		*header_directory_page(header, 0) = get_unused_page_num(pager);
+		get_page(pager, *header_directory_page(header, 0));
+		*directory_slot(pager, header, 0, true) = new_bucket(pager, 0);
+		pager_commit(pager);
+	} else if (!hash_is_hash_page(get_page(pager, 0))) {
+		printf("File holds a B-tree, not a hash table.\n");
+		exit(EXIT_FAILURE);
+	}
+
+	return table;
+}
+
+/*
+ * The lookup peeks, so a put that changes nothing leaves the commit empty.
+ * Pages are fetched again with get_page just before they are modified.
+*/
+static DbResult hash_write(Table* table, Row* row, bool replace) {
+	Pager* pager = table->pager;
+	pager_begin_write(pager);
+
+	uint64_t hash = hash_id(row->id);
+	void* header = peek_page(pager, 0);
+	uint32_t bucket_page_num = directory_lookup(pager, header, hash);
+	void* bucket = peek_page(pager, bucket_page_num);
+	uint32_t row_num = bucket_find(bucket, row->id);
+	DbResult result = DB_OK;
+
+	if (row_num < *bucket_num_rows(bucket)) {
+		if (replace) {
+			serialize_row(row, bucket_row(get_page(pager, bucket_page_num), row_num));
+		} else {
+			result = DB_DUPLICATE_KEY;
+		}
+	} else {
+		header = get_page(pager, 0);
+		bucket = get_page(pager, bucket_page_num);
+		while (*bucket_num_rows(bucket) == HASH_BUCKET_MAX_ROWS) {
+			bucket_split(pager, header, hash);
+			bucket = get_page(pager, directory_lookup(pager, header, hash));
+		}
+		serialize_row(row, bucket_row(bucket, (*bucket_num_rows(bucket))++));
+		*header_num_rows(header) += 1;
+	}
+
+	pager_commit(pager);
+	return result;
+}
+
+DbResult hash_put(Table* table, Row* row) {
+	return hash_write(table, row, false);
+}
+
+DbResult hash_upsert(Table* table, Row* row) {
+	return hash_write(table, row, true);
+}
+
+DbResult hash_get(Table* table, uint64_t id, Row* row) {
+	void* header = get_page(table->pager, 0);
+	void* bucket = get_page(table->pager, directory_lookup(table->pager, header, hash_id(id)));
+	uint32_t row_num = bucket_find(bucket, id);
+	if (row_num == *bucket_num_rows(bucket)) {
+		return DB_NOT_FOUND;
+	}
+
+	deserialize_row(bucket_row(bucket, row_num), row);
+	return DB_OK;
+}
+
+uint32_t hash_count(Table* table) {
+	return *header_num_rows(get_page(table->pager, 0));
+}
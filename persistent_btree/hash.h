@@ -0,0 +1,66 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "table.h"
+#include "btree.h"
+
+/*
+ * Extendible hashing: an unordered access method over the same pager and row
+ * format as the B-tree, for workloads that only get and put by id. A table
+ * is created as one or the other, and page 0 records which: a hash table's
+ * page 0 starts with HASH_MAGIC where a B-tree's starts with a node type.
+ *
+ * Page 0 holds the global depth and the page numbers of the directory: 2^depth
+ * bucket page numbers, indexed by the low bits of the id's hash, spread
+ * over as many pages as they fill. A bucket page holds up to
+ * HASH_BUCKET_MAX_ROWS rows and its local depth, the number of hash bits
+ * all of its rows share. A full bucket splits on its next bit, doubling the
+ * directory first if the bucket already uses every bit it has, so a get
+ * reads page 0, one directory page and one bucket page.
+*/
+static const uint32_t HASH_MAGIC = 0x48534148;
+
+/*
+ * Header Page Layout
+*/
+static const uint32_t HASH_MAGIC_SIZE = sizeof(uint32_t);
+static const uint32_t HASH_MAGIC_OFFSET = 0;
+static const uint32_t HASH_GLOBAL_DEPTH_SIZE = sizeof(uint32_t);
+static const uint32_t HASH_GLOBAL_DEPTH_OFFSET = HASH_MAGIC_OFFSET + HASH_MAGIC_SIZE;
+static const uint32_t HASH_NUM_ROWS_SIZE = sizeof(uint32_t);
+static const uint32_t HASH_NUM_ROWS_OFFSET = HASH_GLOBAL_DEPTH_OFFSET + HASH_GLOBAL_DEPTH_SIZE;
+static const uint32_t HASH_DIRECTORY_PAGES_OFFSET = HASH_NUM_ROWS_OFFSET + HASH_NUM_ROWS_SIZE;
+
+/* Page numbers stay below TABLE_MAX_PAGES, so directory slots are 16 bits. */
+static const uint32_t HASH_DIRECTORY_SLOT_SIZE = sizeof(uint16_t);
+static const uint32_t HASH_SLOTS_PER_PAGE = PAGE_SIZE / HASH_DIRECTORY_SLOT_SIZE;
+static const uint32_t HASH_MAX_GLOBAL_DEPTH = 16;
+
+/*
+ * Bucket Page Layout
+*/
+static const uint32_t HASH_LOCAL_DEPTH_SIZE = sizeof(uint32_t);
+static const uint32_t HASH_LOCAL_DEPTH_OFFSET = 0;
+static const uint32_t HASH_BUCKET_NUM_ROWS_SIZE = sizeof(uint32_t);
+static const uint32_t HASH_BUCKET_NUM_ROWS_OFFSET = HASH_LOCAL_DEPTH_OFFSET + HASH_LOCAL_DEPTH_SIZE;
+static const uint32_t HASH_BUCKET_HEADER_SIZE = HASH_LOCAL_DEPTH_SIZE + HASH_BUCKET_NUM_ROWS_SIZE;
+static const uint32_t HASH_BUCKET_MAX_ROWS = (PAGE_SIZE - HASH_BUCKET_HEADER_SIZE) / ROW_SIZE;
+
+bool hash_is_hash_page(void* page);
+
+Table* hash_open(const char* filename);
+
+Table* hash_open_mode(const char* filename, PagerMode mode);
+
+DbResult hash_put(Table* table, Row* row);
+
+DbResult hash_upsert(Table* table, Row* row);
+
+DbResult hash_get(Table* table, uint64_t id, Row* row);
+
+uint32_t hash_count(Table* table);
+
+#endif // HASH_H
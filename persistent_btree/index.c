@@ -0,0 +1,285 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "table.h"
+#include "node.h"
+#include "index.h"
+#include "cache.h"
+#include "bloom.h"
+#include "version.h"
+
+static uint32_t* catalog_root(Pager* pager, Column column) {
+	return get_page(pager, 0) + CATALOG_OFFSET + (column - COLUMN_USERNAME) * sizeof(uint32_t);
+}
+
+bool index_exists(Table* table, Column column) {
+	return column != COLUMN_ID && *catalog_root(table->pager, column) != 0;
+}
+
+/* Fills tree with a Table for the index that shares table's pager and txn. */
+void index_tree(Table* table, Column column, Table* tree) {
+	tree->pager = table->pager;
+	tree->root_page_num = *catalog_root(table->pager, column);
+	tree->txn = table->txn;
+	tree->row_cache = NULL;
+	tree->bloom_page_num = 0;
+	tree->versions = NULL;
+}
+
+/* The prefix shared by every entry for text, and the key a lookup seeks to. */
+void index_key(const char* text, Key* key) {
+	key_init(key);
+	key_append_uint32(key, hash_bytes(text, strlen(text)));
+}
+
+static const char* row_column(Row* row, Column column) {
+	return column == COLUMN_USERNAME ? row->username : row->email;
+}
+
+static void index_entry_key(Row* row, Column column, Key* key) {
+	index_key(row_column(row, column), key);
+	key_append_uint64(key, row->id);
+}
+
+/* The id an entry refers to: the big-endian component after the hash. */
+uint64_t index_entry_id(const Key* key) {
+	uint64_t id = 0;
+	for (uint32_t i = sizeof(uint32_t); i < sizeof(uint32_t) + sizeof(uint64_t); i++) {
+		id = (id << 8) | key->bytes[i];
+	}
+	return id;
+}
+
+/* Replaces the row in the cell under cursor and stamps it with the current transaction. */
+static void overwrite_cell(Cursor* cursor, Row* row) {
+	Table* table = cursor->table;
+	void* node = get_page(table->pager, cursor->page_num);
+	serialize_row(row, leaf_node_value(node, cursor->cell_num));
+	*leaf_node_txn(node, cursor->cell_num) = table->txn;
+	*node_txn(node) = table->txn;
+}
+
+/*
+ * Adds row's entry, reviving it if a deleted copy was kept in place. An
+ * entry that is still live, one whose deletion was deferred while a
+ * snapshot was held, is left as it is.
+*/
+static void index_insert(Table* table, Column column, Row* row) {
+	Table tree;
+	index_tree(table, column, &tree);
+
+	Key key;
+	index_entry_key(row, column, &key);
+
+	Cursor* cursor = table_find(&tree, &key);
+	if (!cursor_at_key(cursor, &key)) {
+		leaf_node_insert(cursor, &key, NULL);
+	} else if (*leaf_node_txn(peek_page(table->pager, cursor->page_num), cursor->cell_num) == LEAF_NODE_DELETED_TXN) {
+		void* node = get_page(table->pager, cursor->page_num);
+		*leaf_node_txn(node, cursor->cell_num) = table->txn;
+		*node_txn(node) = table->txn;
+	}
+	free(cursor);
+}
+
+static void index_delete(Table* table, Column column, Row* row) {
+	Table tree;
+	index_tree(table, column, &tree);
+
+	Key key;
+	index_entry_key(row, column, &key);
+
+	Cursor* cursor = table_find(&tree, &key);
+	if (cursor_at_key(cursor, &key)) {
+		leaf_node_delete(cursor);
+	}
+	free(cursor);
+}
+
+/*
+ * Builds an index over the existing rows. Returns false if the column is
+ * already indexed.
+*/
+bool index_create(Table* table, Column column) {
+	if (column == COLUMN_ID || index_exists(table, column)) {
+		return false;
+	}
+
+	table_begin_write(table);
+
+	uint32_t root_page_num = get_unused_page_num(table->pager);
+	void* root = get_page(table->pager, root_page_num);
+	initialize_leaf_node(root, 0);
+	set_node_root(root, true);
+	*catalog_root(table->pager, column) = root_page_num;
+
+	Row row;
+	Cursor* cursor = table_start(table);
+	while (!cursor->end_of_table) {
+		deserialize_row(cursor_value(cursor), &row);
+		index_insert(table, column, &row);
+		cursor_advance(cursor);
+	}
+	free(cursor);
+
+	table_commit(table);
+	return true;
+}
+
+/* Inserts row at cursor and into every index, as one transaction. */
+void indexed_insert(Cursor* cursor, Row* row) {
+	Table* table = cursor->table;
+	table_begin_write(table);
+
+	if (table->row_cache != NULL) {
+		row_cache_invalidate(table->row_cache, row->id);
+	}
+
+	Key key;
+	key_from_uint64(&key, row->id);
+	leaf_node_insert(cursor, &key, row);
+	bloom_add(table, row->id);
+	for (Column column = COLUMN_USERNAME; column <= COLUMN_EMAIL; column++) {
+		if (index_exists(table, column)) {
+			index_insert(table, column, row);
+		}
+	}
+
+	table_commit(table);
+}
+
+/*
+ * Overwrites the row under cursor, which has the same id. Where an indexed
+ * column changed, the new value gets an entry and the old value's entry is
+ * deleted. While a snapshot is held, the replaced row is kept as a version
+ * and its entries are left for indexed_release_snapshot, so the snapshot
+ * still finds the row as it was.
+*/
+static void indexed_replace(Cursor* cursor, Row* row) {
+	Table* table = cursor->table;
+	table_begin_write(table);
+
+	if (table->row_cache != NULL) {
+		row_cache_invalidate(table->row_cache, row->id);
+	}
+
+	void* node = get_page(table->pager, cursor->page_num);
+	void* old_value = leaf_node_value(node, cursor->cell_num);
+	Row old_row;
+	deserialize_row(old_value, &old_row);
+	bool keep_old = version_snapshots_held(table);
+	if (keep_old) {
+		version_add(table, old_value, *leaf_node_txn(node, cursor->cell_num));
+	}
+	overwrite_cell(cursor, row);
+
+	for (Column column = COLUMN_USERNAME; column <= COLUMN_EMAIL; column++) {
+		if (!index_exists(table, column)) {
+			continue;
+		}
+
+		Key old_key;
+		Key new_key;
+		index_entry_key(&old_row, column, &old_key);
+		index_entry_key(row, column, &new_key);
+
+		if (key_compare(&old_key, &new_key) != 0) {
+			if (!keep_old) {
+				index_delete(table, column, &old_row);
+			}
+			index_insert(table, column, row);
+		}
+	}
+
+	table_commit(table);
+}
+
+/* Whether row's entry for column is also the entry of its id's current row or of another kept version. */
+static bool index_entry_needed(Table* table, Column column, Row* row) {
+	Key entry_key;
+	Key other_key;
+	Row other;
+	index_entry_key(row, column, &entry_key);
+
+	Key key;
+	key_from_uint64(&key, row->id);
+	Cursor* cursor = table_find(table, &key);
+	bool found = cursor_at_key(cursor, &key);
+	if (found) {
+		deserialize_row(leaf_node_value(get_page(table->pager, cursor->page_num), cursor->cell_num), &other);
+	}
+	free(cursor);
+	if (found) {
+		index_entry_key(&other, column, &other_key);
+		if (key_compare(&entry_key, &other_key) == 0) {
+			return true;
+		}
+	}
+
+	VersionStore* store = table->versions;
+	for (uint32_t i = 0; i < store->num_versions; i++) {
+		if (store->versions[i].id != row->id) {
+			continue;
+		}
+		deserialize_row(store->values + (size_t)i * ROW_SIZE, &other);
+		index_entry_key(&other, column, &other_key);
+		if (key_compare(&entry_key, &other_key) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/*
+ * Ends a snapshot held with version_hold_snapshot. Versions no remaining
+ * snapshot can see are dropped, and in one transaction, so are the index
+ * entries only they still needed.
+*/
+void indexed_release_snapshot(Table* table, uint32_t snapshot_txn) {
+	version_release_snapshot(table, snapshot_txn);
+
+	bool writing = false;
+	Row old_row;
+	while (version_take_expired(table, &old_row)) {
+		for (Column column = COLUMN_USERNAME; column <= COLUMN_EMAIL; column++) {
+			if (!index_exists(table, column) || index_entry_needed(table, column, &old_row)) {
+				continue;
+			}
+			if (!writing) {
+				table_begin_write(table);
+				writing = true;
+			}
+			index_delete(table, column, &old_row);
+		}
+	}
+
+	if (writing) {
+		table_commit(table);
+	}
+}
+
+/*
+ * Descends once to the leaf where row's id belongs and checks for the id
+ * there. A new id is inserted; an existing one is rejected, or overwritten
+ * if replace is set.
+*/
+PutResult indexed_put(Table* table, Row* row, bool replace) {
+	Key key;
+	key_from_uint64(&key, row->id);
+	Cursor* cursor = table_find(table, &key);
+
+	PutResult result = PUT_INSERTED;
+	if (!cursor_at_key(cursor, &key)) {
+		indexed_insert(cursor, row);
+	} else if (replace) {
+		indexed_replace(cursor, row);
+		result = PUT_REPLACED;
+	} else {
+		result = PUT_DUPLICATE;
+	}
+
+	free(cursor);
+	return result;
+}
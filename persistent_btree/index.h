@@ -0,0 +1,44 @@
+#ifndef INDEX_H
+#define INDEX_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "table.h"
+
+/*
+ * Secondary indexes on username and email. Each is a second B-tree in the
+ * table's own file, found through the catalog on page 0, so index entries
+ * are written in the same transaction as the rows they describe.
+ *
+ * An entry is keyed by the composite (hash of the column, id) and holds no
+ * value: its leaves are built with a value size of 0, so an index costs a
+ * fraction of the table's pages and rows are read from the table itself.
+ * Ids are unique, so every entry has its own key; a lookup seeks to the
+ * bare hash and reads the run of keys it prefixes, which also holds any
+ * strings that collide with it.
+*/
+
+typedef enum {
+	PUT_INSERTED,
+	PUT_REPLACED,
+	PUT_DUPLICATE
+} PutResult;
+
+bool index_exists(Table* table, Column column);
+
+void index_tree(Table* table, Column column, Table* tree);
+
+void index_key(const char* text, Key* key);
+
+uint64_t index_entry_id(const Key* key);
+
+bool index_create(Table* table, Column column);
+
+void indexed_insert(Cursor* cursor, Row* row);
+
+PutResult indexed_put(Table* table, Row* row, bool replace);
+
+void indexed_release_snapshot(Table* table, uint32_t snapshot_txn);
+
+#endif // INDEX_H
@@ -0,0 +1,87 @@
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "key.h"
+
+int key_compare(const Key* a, const Key* b) {
+	uint32_t length = a->length < b->length ? a->length : b->length;
+	int compared = memcmp(a->bytes, b->bytes, length);
+	if (compared != 0) {
+		return compared;
+	}
+	return (a->length > b->length) - (a->length < b->length);
+}
+
+bool key_has_prefix(const Key* key, const Key* prefix) {
+	return key->length >= prefix->length && memcmp(key->bytes, prefix->bytes, prefix->length) == 0;
+}
+
+/*
+ * Shortest key s with low <= s < high, for low < high: the bytes the two
+ * share plus low's next byte, bumped by one when that still sorts below
+ * high. Anything longer is no better than low itself.
+*/
+void key_separator(const Key* low, const Key* high, Key* separator) {
+	uint32_t shared = 0;
+	while (shared < low->length && shared < high->length && low->bytes[shared] == high->bytes[shared]) {
+		shared++;
+	}
+
+	*separator = *low;
+	if (shared + 1 >= low->length) {
+		return;
+	}
+
+	uint32_t bumped = low->bytes[shared] + 1;
+	if (bumped < high->bytes[shared] || (bumped == high->bytes[shared] && high->length > shared + 1)) {
+		separator->length = shared + 1;
+		separator->bytes[shared] = bumped;
+	}
+}
+
+void key_init(Key* key) {
+	key->length = 0;
+}
+
+bool key_append_bytes(Key* key, const void* bytes, uint32_t length) {
+	if (key->length + length > KEY_MAX_SIZE) {
+		return false;
+	}
+
+	memcpy(key->bytes + key->length, bytes, length);
+	key->length += length;
+	return true;
+}
+
+bool key_append_uint32(Key* key, uint32_t value) {
+	uint8_t bytes[4];
+	for (int i = 3; i >= 0; i--) {
+		bytes[i] = value & 0xff;
+		value >>= 8;
+	}
+	return key_append_bytes(key, bytes, sizeof(bytes));
+}
+
+bool key_append_uint64(Key* key, uint64_t value) {
+	uint8_t bytes[8];
+	for (int i = 7; i >= 0; i--) {
+		bytes[i] = value & 0xff;
+		value >>= 8;
+	}
+	return key_append_bytes(key, bytes, sizeof(bytes));
+}
+
+void key_from_uint64(Key* key, uint64_t value) {
+	key_init(key);
+	key_append_uint64(key, value);
+}
+
+/* Reads the leading 8-byte integer component. */
+uint64_t key_to_uint64(const Key* key) {
+	uint64_t value = 0;
+	for (uint32_t i = 0; i < 8 && i < key->length; i++) {
+		value = (value << 8) | key->bytes[i];
+	}
+	return value;
+}
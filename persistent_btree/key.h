@@ -0,0 +1,40 @@
+#ifndef KEY_H
+#define KEY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define KEY_MAX_SIZE 16
+
+/*
+ * B-tree keys are byte strings of up to KEY_MAX_SIZE bytes, ordered like
+ * memcmp with a shorter key sorting before any key it is a prefix of.
+ * Integers are stored big-endian so byte order is numeric order, and a
+ * composite key is its components appended in order. Fixed-width components
+ * compare component by component; a variable-length byte string should be
+ * the last component.
+*/
+typedef struct {
+	uint8_t length;
+	uint8_t bytes[KEY_MAX_SIZE];
+} Key;
+
+int key_compare(const Key* a, const Key* b);
+
+bool key_has_prefix(const Key* key, const Key* prefix);
+
+void key_separator(const Key* low, const Key* high, Key* separator);
+
+void key_init(Key* key);
+
+bool key_append_uint32(Key* key, uint32_t value);
+
+bool key_append_uint64(Key* key, uint64_t value);
+
+bool key_append_bytes(Key* key, const void* bytes, uint32_t length);
+
+void key_from_uint64(Key* key, uint64_t value);
+
+uint64_t key_to_uint64(const Key* key);
+
+#endif // KEY_H
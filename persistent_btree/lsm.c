@@ -0,0 +1,890 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "table.h"
+#include "btree.h"
+#include "lsm.h"
+#include "stats.h"
+
+#define LSM_MAX_PATH 4096
+
+typedef struct {
+	int file_descriptor;
+	uint8_t* page;
+	uint32_t num_rows;
+	uint32_t num_pages;
+	uint32_t capacity;
+	uint64_t* first_ids;
+	uint32_t seq;
+} RunWriter;
+
+static uint64_t row_id(const void* value) {
+	uint64_t id;
+	memcpy(&id, value + ID_OFFSET, ID_SIZE);
+	return id;
+}
+
+static int compare_values(const void* a, const void* b) {
+	uint64_t x = row_id(a);
+	uint64_t y = row_id(b);
+	return (x > y) - (x < y);
+}
+
+static void lsm_path(const char* filename, uint32_t seq, const char* suffix, char* path) {
+	snprintf(path, LSM_MAX_PATH, "%s.%u.%s", filename, seq, suffix);
+}
+
+static void write_or_die(int file_descriptor, const void* buffer, size_t length) {
+	ssize_t bytes_written = write(file_descriptor, buffer, length);
+	if (bytes_written != (ssize_t)length) {
+		printf("Error writing: %d\n", errno);
+		exit(EXIT_FAILURE);
+	}
+}
+
+static void read_or_die(int file_descriptor, void* buffer, size_t length, off_t offset) {
+	ssize_t bytes_read = pread(file_descriptor, buffer, length, offset);
+	if (bytes_read != (ssize_t)length) {
+		printf("Error reading file: %d\n", errno);
+		exit(EXIT_FAILURE);
+	}
+}
+
+static void sync_or_die(int file_descriptor) {
+	if (fsync(file_descriptor) == -1) {
+		printf("Error syncing: %d\n", errno);
+		exit(EXIT_FAILURE);
+	}
+}
+
+/*
+ * Memtable
+*/
+
+static Memtable* memtable_new(uint32_t capacity, uint32_t wal_seq) {
+	uint32_t num_slots = 1;
+	while (num_slots < 2 * capacity) {
+		num_slots <<= 1;
+	}
+
+	Memtable* memtable = malloc(sizeof(Memtable));
+	memtable->rows = malloc((size_t)capacity * ROW_SIZE);
+	memtable->slots = calloc(num_slots, sizeof(uint32_t));
+	memtable->num_rows = 0;
+	memtable->capacity = capacity;
+	memtable->mask = num_slots - 1;
+	memtable->wal_seq = wal_seq;
+	return memtable;
+}
+
+static void memtable_free(Memtable* memtable) {
+	free(memtable->rows);
+	free(memtable->slots);
+	free(memtable);
+}
+
+static void* memtable_row(Memtable* memtable, uint32_t row_num) {
+	return memtable->rows + (size_t)row_num * ROW_SIZE;
+}
+
+/* The slot holding id's row number plus one, or the empty slot id would take. */
+static uint32_t* memtable_slot(Memtable* memtable, uint64_t id) {
+	uint32_t slot = (id * 11400714819323198485ull) >> 32 & memtable->mask;
+	while (memtable->slots[slot] != 0 && row_id(memtable_row(memtable, memtable->slots[slot] - 1)) != id) {
+		slot = (slot + 1) & memtable->mask;
+	}
+	return &memtable->slots[slot];
+}
+
+static void memtable_put(Memtable* memtable, const void* value) {
+	uint32_t* slot = memtable_slot(memtable, row_id(value));
+	if (*slot == 0) {
+		*slot = ++memtable->num_rows;
+	}
+	memcpy(memtable_row(memtable, *slot - 1), value, ROW_SIZE);
+}
+
+static void* memtable_get(Memtable* memtable, uint64_t id) {
+	uint32_t* slot = memtable_slot(memtable, id);
+	return *slot == 0 ? NULL : memtable_row(memtable, *slot - 1);
+}
+
+/* Copies the rows with ids in [start_id, end_id] into a new array, sorted. */
+static uint32_t memtable_collect(Memtable* memtable, uint64_t start_id, uint64_t end_id, uint8_t** rows) {
+	*rows = malloc((size_t)memtable->num_rows * ROW_SIZE);
+	uint32_t num_rows = 0;
+	for (uint32_t i = 0; i < memtable->num_rows; i++) {
+		uint64_t id = row_id(memtable_row(memtable, i));
+		if (id >= start_id && id <= end_id) {
+			memcpy(*rows + (size_t)num_rows++ * ROW_SIZE, memtable_row(memtable, i), ROW_SIZE);
+		}
+	}
+	qsort(*rows, num_rows, ROW_SIZE, compare_values);
+	return num_rows;
+}
+
+/*
+ * Runs
+*/
+
+static uint32_t run_page_rows(LsmRun* run, uint32_t page_num) {
+	uint32_t remaining = run->num_rows - page_num * ROWS_PER_PAGE;
+	return remaining < ROWS_PER_PAGE ? remaining : ROWS_PER_PAGE;
+}
+
+static void run_read_page(LsmRun* run, uint32_t page_num, void* page) {
+	read_or_die(run->file_descriptor, page, PAGE_SIZE, (off_t)(page_num + 1) * PAGE_SIZE);
+	stats_add(STAT_PAGE_READS, 1);
+}
+
+/* The last data page whose first id is at most id, or page 0 if there is none. */
+static uint32_t run_find_page(LsmRun* run, uint64_t id) {
+	uint32_t min_index = 0;
+	uint32_t one_past_max_index = run->num_pages;
+	while (one_past_max_index != min_index) {
+		uint32_t index = (min_index + one_past_max_index) / 2;
+		if (run->first_ids[index] <= id) {
+			min_index = index + 1;
+		} else {
+			one_past_max_index = index;
+		}
+	}
+	return min_index > 0 ? min_index - 1 : 0;
+}
+
+/* Position of the first row on the page with an id of at least id. */
+static uint32_t page_lower_bound(const uint8_t* page, uint32_t num_rows, uint64_t id) {
+	uint32_t min_index = 0;
+	uint32_t one_past_max_index = num_rows;
+	while (one_past_max_index != min_index) {
+		uint32_t index = (min_index + one_past_max_index) / 2;
+		if (row_id(page + index * ROW_SIZE) < id) {
+			min_index = index + 1;
+		} else {
+			one_past_max_index = index;
+		}
+	}
+	return min_index;
+}
+
+static LsmRun* run_open(const char* filename, uint32_t seq) {
+	char path[LSM_MAX_PATH];
+	lsm_path(filename, seq, "run", path);
+	int fd = open(path, O_RDONLY);
+	if (fd == -1) {
+		printf("Unable to open run file\n");
+		exit(EXIT_FAILURE);
+	}
+
+	uint32_t header[3];
+	read_or_die(fd, header, sizeof(header), 0);
+	if (header[LSM_RUN_MAGIC_OFFSET / sizeof(uint32_t)] != LSM_RUN_MAGIC) {
+		printf("Run file is not a run. Corrupt file.\n");
+		exit(EXIT_FAILURE);
+	}
+
+	LsmRun* run = malloc(sizeof(LsmRun));
+	run->seq = seq;
+	run->file_descriptor = fd;
+	run->num_rows = header[LSM_RUN_NUM_ROWS_OFFSET / sizeof(uint32_t)];
+	run->tier = header[LSM_RUN_TIER_OFFSET / sizeof(uint32_t)];
+	run->num_pages = (run->num_rows + ROWS_PER_PAGE - 1) / ROWS_PER_PAGE;
+	run->first_ids = malloc((run->num_pages + 1) * sizeof(uint64_t));
+	run->refs = 1;
+	run->obsolete = false;
+
+	for (uint32_t i = 0; i < run->num_pages; i++) {
+		read_or_die(fd, &run->first_ids[i], ID_SIZE, (off_t)(i + 1) * PAGE_SIZE + ID_OFFSET);
+	}
+	return run;
+}
+
+/* Drops a reference. The last one closes the run, and deletes it if compacted away. */
+static void run_release(Lsm* lsm, LsmRun* run) {
+	pthread_mutex_lock(&lsm->lock);
+	bool last = --run->refs == 0;
+	pthread_mutex_unlock(&lsm->lock);
+	if (!last) {
+		return;
+	}
+
+	close(run->file_descriptor);
+	if (run->obsolete) {
+		char path[LSM_MAX_PATH];
+		lsm_path(lsm->filename, run->seq, "run", path);
+		unlink(path);
+	}
+	free(run->first_ids);
+	free(run);
+}
+
+static bool run_get(LsmRun* run, uint64_t id, uint8_t* page, Row* row) {
+	if (run->num_rows == 0 || id < run->first_ids[0]) {
+		return false;
+	}
+
+	uint32_t page_num = run_find_page(run, id);
+	uint32_t num_rows = run_page_rows(run, page_num);
+	run_read_page(run, page_num, page);
+	uint32_t position = page_lower_bound(page, num_rows, id);
+	if (position == num_rows || row_id(page + position * ROW_SIZE) != id) {
+		return false;
+	}
+
+	deserialize_row(page + position * ROW_SIZE, row);
+	return true;
+}
+
+static void run_writer_open(Lsm* lsm, RunWriter* writer, uint32_t seq) {
+	char path[LSM_MAX_PATH];
+	lsm_path(lsm->filename, seq, "run", path);
+	writer->file_descriptor = open(path, O_RDWR | O_CREAT | O_TRUNC, S_IWUSR | S_IRUSR);
+	if (writer->file_descriptor == -1) {
+		printf("Unable to open file\n");
+		exit(EXIT_FAILURE);
+	}
+
+	writer->page = calloc(1, PAGE_SIZE);
+	write_or_die(writer->file_descriptor, writer->page, PAGE_SIZE);
+	writer->num_rows = 0;
+	writer->num_pages = 0;
+	writer->capacity = 16;
+	writer->first_ids = malloc(writer->capacity * sizeof(uint64_t));
+	writer->seq = seq;
+}
+
+static void run_writer_flush_page(RunWriter* writer) {
+	write_or_die(writer->file_descriptor, writer->page, PAGE_SIZE);
+	stats_add(STAT_PAGE_WRITES, 1);
+	memset(writer->page, 0, PAGE_SIZE);
+}
+
+/* Values must arrive in strictly increasing id order. */
+static void run_writer_add(RunWriter* writer, const void* value) {
+	uint32_t position = writer->num_rows % ROWS_PER_PAGE;
+	if (position == 0) {
+		if (writer->num_pages == writer->capacity) {
+			writer->capacity *= 2;
+			writer->first_ids = realloc(writer->first_ids, writer->capacity * sizeof(uint64_t));
+		}
+		writer->first_ids[writer->num_pages++] = row_id(value);
+	}
+
+	memcpy(writer->page + position * ROW_SIZE, value, ROW_SIZE);
+	writer->num_rows++;
+	if (position + 1 == ROWS_PER_PAGE) {
+		run_writer_flush_page(writer);
+	}
+}
+
+/* Writes the last page and the header page and syncs, so the run is durable before it is published. */
+static LsmRun* run_writer_finish(RunWriter* writer, uint32_t tier) {
+	if (writer->num_rows % ROWS_PER_PAGE != 0) {
+		run_writer_flush_page(writer);
+	}
+
+	uint32_t header[3];
+	header[LSM_RUN_MAGIC_OFFSET / sizeof(uint32_t)] = LSM_RUN_MAGIC;
+	header[LSM_RUN_NUM_ROWS_OFFSET / sizeof(uint32_t)] = writer->num_rows;
+	header[LSM_RUN_TIER_OFFSET / sizeof(uint32_t)] = tier;
+	if (pwrite(writer->file_descriptor, header, sizeof(header), 0) != (ssize_t)sizeof(header)) {
+		printf("Error writing: %d\n", errno);
+		exit(EXIT_FAILURE);
+	}
+	sync_or_die(writer->file_descriptor);
+
+	LsmRun* run = malloc(sizeof(LsmRun));
+	run->seq = writer->seq;
+	run->tier = tier;
+	run->file_descriptor = writer->file_descriptor;
+	run->num_rows = writer->num_rows;
+	run->num_pages = writer->num_pages;
+	run->first_ids = writer->first_ids;
+	run->refs = 1;
+	run->obsolete = false;
+
+	free(writer->page);
+	return run;
+}
+
+/*
+ * Manifest
+*/
+
+/* Encodes the manifest as it stands; the caller holds the lock. */
+static uint32_t manifest_encode(Lsm* lsm, uint32_t* buffer) {
+	buffer[LSM_MANIFEST_MAGIC_OFFSET / sizeof(uint32_t)] = LSM_MANIFEST_MAGIC;
+	buffer[LSM_MANIFEST_NEXT_RUN_OFFSET / sizeof(uint32_t)] = lsm->next_run_seq;
+	buffer[LSM_MANIFEST_FIRST_WAL_OFFSET / sizeof(uint32_t)] = lsm->first_wal_seq;
+	buffer[LSM_MANIFEST_NUM_RUNS_OFFSET / sizeof(uint32_t)] = lsm->num_runs;
+	for (uint32_t i = 0; i < lsm->num_runs; i++) {
+		buffer[LSM_MANIFEST_RUNS_OFFSET / sizeof(uint32_t) + i] = lsm->runs[i]->seq;
+	}
+	return LSM_MANIFEST_RUNS_OFFSET + lsm->num_runs * sizeof(uint32_t);
+}
+
+/* Replaces the manifest atomically: a synced temporary file renamed over it. */
+static void manifest_store(Lsm* lsm, const uint32_t* buffer, uint32_t length) {
+	char path[LSM_MAX_PATH];
+	snprintf(path, LSM_MAX_PATH, "%s.tmp", lsm->filename);
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, S_IWUSR | S_IRUSR);
+	if (fd == -1) {
+		printf("Unable to open file\n");
+		exit(EXIT_FAILURE);
+	}
+	write_or_die(fd, buffer, length);
+	sync_or_die(fd);
+	close(fd);
+
+	if (rename(path, lsm->filename) == -1) {
+		printf("Error replacing manifest: %d\n", errno);
+		exit(EXIT_FAILURE);
+	}
+}
+
+static void manifest_load(Lsm* lsm) {
+	int fd = open(lsm->filename, O_RDONLY);
+	if (fd == -1) {
+		lsm->next_run_seq = 0;
+		lsm->first_wal_seq = 0;
+		lsm->num_runs = 0;
+		uint32_t buffer[LSM_MANIFEST_RUNS_OFFSET / sizeof(uint32_t)];
+		manifest_store(lsm, buffer, manifest_encode(lsm, buffer));
+		return;
+	}
+
+	uint32_t header[LSM_MANIFEST_RUNS_OFFSET / sizeof(uint32_t)];
+	read_or_die(fd, header, sizeof(header), 0);
+	if (header[LSM_MANIFEST_MAGIC_OFFSET / sizeof(uint32_t)] != LSM_MANIFEST_MAGIC
+		|| header[LSM_MANIFEST_NUM_RUNS_OFFSET / sizeof(uint32_t)] > LSM_MAX_RUNS) {
+		printf("Manifest is not an LSM manifest. Corrupt file.\n");
+		exit(EXIT_FAILURE);
+	}
+
+	lsm->next_run_seq = header[LSM_MANIFEST_NEXT_RUN_OFFSET / sizeof(uint32_t)];
+	lsm->first_wal_seq = header[LSM_MANIFEST_FIRST_WAL_OFFSET / sizeof(uint32_t)];
+	lsm->num_runs = header[LSM_MANIFEST_NUM_RUNS_OFFSET / sizeof(uint32_t)];
+
+	uint32_t seqs[LSM_MAX_RUNS];
+	read_or_die(fd, seqs, lsm->num_runs * sizeof(uint32_t), LSM_MANIFEST_RUNS_OFFSET);
+	close(fd);
+	for (uint32_t i = 0; i < lsm->num_runs; i++) {
+		lsm->runs[i] = run_open(lsm->filename, seqs[i]);
+	}
+}
+
+/*
+ * Merged iteration
+*/
+
+static LsmIterator* iterator_new(Lsm* lsm, uint32_t num_sources, uint64_t end_id) {
+	LsmIterator* iterator = malloc(sizeof(LsmIterator));
+	iterator->lsm = lsm;
+	iterator->sources = calloc(num_sources, sizeof(LsmSource));
+	iterator->num_sources = 0;
+	iterator->end_id = end_id;
+	iterator->value = malloc(ROW_SIZE);
+	return iterator;
+}
+
+static void iterator_add_memtable(LsmIterator* iterator, Memtable* memtable, uint64_t start_id) {
+	LsmSource* source = &iterator->sources[iterator->num_sources++];
+	source->num_rows = memtable_collect(memtable, start_id, iterator->end_id, &source->rows);
+}
+
+/* The caller holds the lock, and the reference taken here is the iterator's. */
+static void iterator_add_run(LsmIterator* iterator, LsmRun* run) {
+	LsmSource* source = &iterator->sources[iterator->num_sources++];
+	run->refs++;
+	source->run = run;
+	source->page = malloc(PAGE_SIZE);
+}
+
+static const uint8_t* source_peek(LsmSource* source) {
+	if (source->run == NULL) {
+		return source->position < source->num_rows ? source->rows + (size_t)source->position * ROW_SIZE : NULL;
+	}
+	return source->page_num < source->run->num_pages ? source->page + source->position * ROW_SIZE : NULL;
+}
+
+/* Moves past the end of the page onto the next one, if the position has reached it. */
+static void source_settle(LsmSource* source) {
+	if (source->page_num < source->run->num_pages && source->position == run_page_rows(source->run, source->page_num)) {
+		source->page_num++;
+		source->position = 0;
+		if (source->page_num < source->run->num_pages) {
+			run_read_page(source->run, source->page_num, source->page);
+		}
+	}
+}
+
+static void source_seek(LsmSource* source, uint64_t start_id) {
+	LsmRun* run = source->run;
+	if (run->num_rows == 0) {
+		source->page_num = 0;
+		return;
+	}
+
+	source->page_num = run_find_page(run, start_id);
+	run_read_page(run, source->page_num, source->page);
+	source->position = page_lower_bound(source->page, run_page_rows(run, source->page_num), start_id);
+	source_settle(source);
+}
+
+static void source_advance(LsmSource* source) {
+	source->position++;
+	if (source->run != NULL) {
+		source_settle(source);
+	}
+}
+
+/* The next row in id order, serialized, or NULL past end_id. Older copies of it are skipped. */
+static const uint8_t* iterator_next_value(LsmIterator* iterator) {
+	const uint8_t* best = NULL;
+	for (uint32_t i = 0; i < iterator->num_sources; i++) {
+		const uint8_t* value = source_peek(&iterator->sources[i]);
+		if (value != NULL && (best == NULL || row_id(value) < row_id(best))) {
+			best = value;
+		}
+	}
+	if (best == NULL || row_id(best) > iterator->end_id) {
+		return NULL;
+	}
+
+	memcpy(iterator->value, best, ROW_SIZE);
+	uint64_t id = row_id(iterator->value);
+	for (uint32_t i = 0; i < iterator->num_sources; i++) {
+		const uint8_t* value = source_peek(&iterator->sources[i]);
+		if (value != NULL && row_id(value) == id) {
+			source_advance(&iterator->sources[i]);
+		}
+	}
+	return iterator->value;
+}
+
+/*
+ * Flush and compaction
+*/
+
+/* Publishes run as the newest; the caller holds the lock. */
+static void lsm_push_run(Lsm* lsm, LsmRun* run) {
+	if (lsm->num_runs == LSM_MAX_RUNS) {
+		printf("Too many runs.\n");
+		exit(EXIT_FAILURE);
+	}
+	memmove(lsm->runs + 1, lsm->runs, lsm->num_runs * sizeof(LsmRun*));
+	lsm->runs[0] = run;
+	lsm->num_runs++;
+}
+
+/*
+ * Writes memtable out as a tier 0 run and publishes it. The memtable's log
+ * is deleted only once the manifest no longer needs it.
+*/
+static void lsm_flush(Lsm* lsm, Memtable* memtable) {
+	uint8_t* rows;
+	uint32_t num_rows = memtable_collect(memtable, 0, UINT64_MAX, &rows);
+
+	pthread_mutex_lock(&lsm->lock);
+	uint32_t seq = lsm->next_run_seq++;
+	pthread_mutex_unlock(&lsm->lock);
+
+	RunWriter writer;
+	run_writer_open(lsm, &writer, seq);
+	for (uint32_t i = 0; i < num_rows; i++) {
+		run_writer_add(&writer, rows + (size_t)i * ROW_SIZE);
+	}
+	LsmRun* run = run_writer_finish(&writer, 0);
+	free(rows);
+
+	uint32_t buffer[LSM_MANIFEST_RUNS_OFFSET / sizeof(uint32_t) + LSM_MAX_RUNS];
+	pthread_mutex_lock(&lsm->lock);
+	lsm_push_run(lsm, run);
+	lsm->first_wal_seq = memtable->wal_seq + 1;
+	if (lsm->frozen == memtable) {
+		lsm->frozen = NULL;
+	}
+	uint32_t length = manifest_encode(lsm, buffer);
+	pthread_cond_broadcast(&lsm->done);
+	pthread_mutex_unlock(&lsm->lock);
+
+	manifest_store(lsm, buffer, length);
+	char path[LSM_MAX_PATH];
+	lsm_path(lsm->filename, memtable->wal_seq, "wal", path);
+	unlink(path);
+	memtable_free(memtable);
+	stats_add(STAT_MEMTABLE_FLUSHES, 1);
+}
+
+/* The caller holds the lock. */
+static bool lsm_compaction_due(Lsm* lsm) {
+	if (lsm->num_runs < LSM_TIER_FANOUT) {
+		return false;
+	}
+	for (uint32_t i = 1; i < LSM_TIER_FANOUT; i++) {
+		if (lsm->runs[i]->tier != lsm->runs[0]->tier) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/*
+ * Merges the LSM_TIER_FANOUT newest runs into one run of the next tier. Only
+ * the worker adds or removes runs, so they are still the newest when the
+ * merged run replaces them.
+*/
+static void lsm_compact(Lsm* lsm) {
+	pthread_mutex_lock(&lsm->lock);
+	LsmRun* inputs[LSM_TIER_FANOUT];
+	memcpy(inputs, lsm->runs, sizeof(inputs));
+	uint32_t tier = inputs[0]->tier;
+	uint32_t seq = lsm->next_run_seq++;
+	LsmIterator* iterator = iterator_new(lsm, LSM_TIER_FANOUT, UINT64_MAX);
+	for (uint32_t i = 0; i < LSM_TIER_FANOUT; i++) {
+		iterator_add_run(iterator, inputs[i]);
+	}
+	pthread_mutex_unlock(&lsm->lock);
+
+	for (uint32_t i = 0; i < LSM_TIER_FANOUT; i++) {
+		source_seek(&iterator->sources[i], 0);
+	}
+
+	RunWriter writer;
+	run_writer_open(lsm, &writer, seq);
+	const uint8_t* value;
+	while ((value = iterator_next_value(iterator)) != NULL) {
+		run_writer_add(&writer, value);
+	}
+	LsmRun* merged = run_writer_finish(&writer, tier + 1);
+	lsm_iterator_close(iterator);
+
+	uint32_t buffer[LSM_MANIFEST_RUNS_OFFSET / sizeof(uint32_t) + LSM_MAX_RUNS];
+	pthread_mutex_lock(&lsm->lock);
+	lsm->num_runs -= LSM_TIER_FANOUT;
+	memmove(lsm->runs, lsm->runs + LSM_TIER_FANOUT, lsm->num_runs * sizeof(LsmRun*));
+	lsm_push_run(lsm, merged);
+	for (uint32_t i = 0; i < LSM_TIER_FANOUT; i++) {
+		inputs[i]->obsolete = true;
+	}
+	uint32_t length = manifest_encode(lsm, buffer);
+	pthread_mutex_unlock(&lsm->lock);
+
+	manifest_store(lsm, buffer, length);
+	for (uint32_t i = 0; i < LSM_TIER_FANOUT; i++) {
+		run_release(lsm, inputs[i]);
+	}
+	stats_add(STAT_COMPACTIONS, 1);
+}
+
+/*
+ * A due compaction goes before a flush, so a writer that outpaces the worker
+ * is held up in lsm_freeze rather than piling up runs. On close only a
+ * pending flush is finished.
+*/
+static void* lsm_worker(void* argument) {
+	Lsm* lsm = argument;
+
+	pthread_mutex_lock(&lsm->lock);
+	while (true) {
+		if (!lsm->closing && lsm_compaction_due(lsm)) {
+			lsm->busy = true;
+			pthread_mutex_unlock(&lsm->lock);
+			lsm_compact(lsm);
+			pthread_mutex_lock(&lsm->lock);
+		} else if (lsm->frozen != NULL) {
+			Memtable* frozen = lsm->frozen;
+			lsm->busy = true;
+			pthread_mutex_unlock(&lsm->lock);
+			lsm_flush(lsm, frozen);
+			pthread_mutex_lock(&lsm->lock);
+		} else if (lsm->closing) {
+			break;
+		} else {
+			lsm->busy = false;
+			pthread_cond_broadcast(&lsm->done);
+			pthread_cond_wait(&lsm->work, &lsm->lock);
+		}
+	}
+	pthread_mutex_unlock(&lsm->lock);
+
+	return NULL;
+}
+
+/*
+ * Engine
+*/
+
+static int wal_open(Lsm* lsm, uint32_t seq) {
+	char path[LSM_MAX_PATH];
+	lsm_path(lsm->filename, seq, "wal", path);
+	int fd = open(path, O_WRONLY | O_CREAT | O_APPEND, S_IWUSR | S_IRUSR);
+	if (fd == -1) {
+		printf("Unable to open file\n");
+		exit(EXIT_FAILURE);
+	}
+	return fd;
+}
+
+/* Loads the log with seq into a memtable big enough for it, or returns NULL if there is none. A torn last row is dropped. */
+static Memtable* wal_replay(Lsm* lsm, uint32_t seq) {
+	char path[LSM_MAX_PATH];
+	lsm_path(lsm->filename, seq, "wal", path);
+	int fd = open(path, O_RDONLY);
+	if (fd == -1) {
+		return NULL;
+	}
+
+	off_t file_length = lseek(fd, 0, SEEK_END);
+	uint32_t num_rows = file_length / ROW_SIZE;
+	Memtable* memtable = memtable_new(num_rows > lsm->memtable_rows ? num_rows : lsm->memtable_rows, seq);
+	uint8_t* rows = malloc((size_t)num_rows * ROW_SIZE);
+	read_or_die(fd, rows, (size_t)num_rows * ROW_SIZE, 0);
+	close(fd);
+
+	for (uint32_t i = 0; i < num_rows; i++) {
+		memtable_put(memtable, rows + (size_t)i * ROW_SIZE);
+	}
+	free(rows);
+	if (file_length % ROW_SIZE != 0 && truncate(path, (off_t)num_rows * ROW_SIZE) == -1) {
+		printf("Error truncating: %d\n", errno);
+		exit(EXIT_FAILURE);
+	}
+	return memtable;
+}
+
+/* Hands the full active memtable to the worker, waiting while it still has the previous one. */
+static void lsm_freeze(Lsm* lsm) {
+	pthread_mutex_lock(&lsm->lock);
+	while (lsm->frozen != NULL) {
+		pthread_cond_wait(&lsm->done, &lsm->lock);
+	}
+	lsm->frozen = lsm->active;
+	lsm->active = memtable_new(lsm->memtable_rows, lsm->next_wal_seq);
+	sync_or_die(lsm->wal_file_descriptor);
+	close(lsm->wal_file_descriptor);
+	lsm->wal_file_descriptor = wal_open(lsm, lsm->next_wal_seq++);
+	pthread_cond_signal(&lsm->work);
+	pthread_mutex_unlock(&lsm->lock);
+}
+
+/*
+ * Opens the engine whose manifest is filename, creating it if missing.
+ * Every log but the newest is flushed to a run before this returns; the
+ * newest becomes the active memtable and keeps taking appends.
+*/
+Lsm* lsm_open(const char* filename, uint32_t memtable_rows) {
+	Lsm* lsm = malloc(sizeof(Lsm));
+	lsm->filename = strdup(filename);
+	lsm->memtable_rows = memtable_rows > 0 ? memtable_rows : 1;
+	lsm->frozen = NULL;
+	lsm->busy = false;
+	lsm->closing = false;
+	pthread_mutex_init(&lsm->lock, NULL);
+	pthread_cond_init(&lsm->work, NULL);
+	pthread_cond_init(&lsm->done, NULL);
+
+	manifest_load(lsm);
+
+	uint32_t seq = lsm->first_wal_seq;
+	Memtable* memtable = NULL;
+	Memtable* next;
+	while ((next = wal_replay(lsm, seq)) != NULL) {
+		if (memtable != NULL) {
+			lsm_flush(lsm, memtable);
+		}
+		memtable = next;
+		seq++;
+	}
+	if (memtable == NULL) {
+		memtable = memtable_new(lsm->memtable_rows, seq);
+	}
+
+	lsm->active = memtable;
+	lsm->next_wal_seq = memtable->wal_seq + 1;
+	lsm->wal_file_descriptor = wal_open(lsm, memtable->wal_seq);
+
+	if (pthread_create(&lsm->worker, NULL, lsm_worker, lsm) != 0) {
+		printf("Error creating LSM worker\n");
+		exit(EXIT_FAILURE);
+	}
+	if (memtable->num_rows >= memtable->capacity) {
+		lsm_freeze(lsm);
+	}
+	return lsm;
+}
+
+/*
+ * Inserts row or replaces the row with its id, without reading anything:
+ * the row is appended to the log and copied into the memtable. The log is
+ * not synced; see lsm_sync.
+*/
+void lsm_put(Lsm* lsm, Row* row) {
+	uint8_t value[ROW_SIZE];
+	serialize_row(row, value);
+	write_or_die(lsm->wal_file_descriptor, value, ROW_SIZE);
+	memtable_put(lsm->active, value);
+
+	if (lsm->active->num_rows == lsm->active->capacity) {
+		lsm_freeze(lsm);
+	}
+}
+
+/* Makes every put so far durable with one fsync of the active log. */
+void lsm_sync(Lsm* lsm) {
+	sync_or_die(lsm->wal_file_descriptor);
+}
+
+/* Checks the memtables, then each run newest first; a run costs one page read. */
+DbResult lsm_get(Lsm* lsm, uint64_t id, Row* row) {
+	void* value = memtable_get(lsm->active, id);
+	if (value != NULL) {
+		deserialize_row(value, row);
+		return DB_OK;
+	}
+
+	pthread_mutex_lock(&lsm->lock);
+	if (lsm->frozen != NULL && (value = memtable_get(lsm->frozen, id)) != NULL) {
+		deserialize_row(value, row);
+		pthread_mutex_unlock(&lsm->lock);
+		return DB_OK;
+	}
+	LsmRun* runs[LSM_MAX_RUNS];
+	uint32_t num_runs = lsm->num_runs;
+	for (uint32_t i = 0; i < num_runs; i++) {
+		runs[i] = lsm->runs[i];
+		runs[i]->refs++;
+	}
+	pthread_mutex_unlock(&lsm->lock);
+
+	uint8_t page[PAGE_SIZE];
+	DbResult result = DB_NOT_FOUND;
+	for (uint32_t i = 0; i < num_runs; i++) {
+		if (result == DB_NOT_FOUND && run_get(runs[i], id, page, row)) {
+			result = DB_OK;
+		}
+		run_release(lsm, runs[i]);
+	}
+	return result;
+}
+
+/*
+ * Iterates ids in [start_id, end_id] in order as of the moment the scan was
+ * opened; puts, flushes and compactions after that are not seen.
+*/
+LsmIterator* lsm_scan(Lsm* lsm, uint64_t start_id, uint64_t end_id) {
+	pthread_mutex_lock(&lsm->lock);
+	LsmIterator* iterator = iterator_new(lsm, 2 + lsm->num_runs, end_id);
+	iterator_add_memtable(iterator, lsm->active, start_id);
+	if (lsm->frozen != NULL) {
+		iterator_add_memtable(iterator, lsm->frozen, start_id);
+	}
+	for (uint32_t i = 0; i < lsm->num_runs; i++) {
+		iterator_add_run(iterator, lsm->runs[i]);
+	}
+	pthread_mutex_unlock(&lsm->lock);
+
+	for (uint32_t i = 0; i < iterator->num_sources; i++) {
+		if (iterator->sources[i].run != NULL) {
+			source_seek(&iterator->sources[i], start_id);
+		}
+	}
+	return iterator;
+}
+
+bool lsm_iterator_next(LsmIterator* iterator, Row* row) {
+	const uint8_t* value = iterator_next_value(iterator);
+	if (value == NULL) {
+		return false;
+	}
+	deserialize_row((void*)value, row);
+	return true;
+}
+
+void lsm_iterator_close(LsmIterator* iterator) {
+	for (uint32_t i = 0; i < iterator->num_sources; i++) {
+		LsmSource* source = &iterator->sources[i];
+		if (source->run != NULL) {
+			run_release(iterator->lsm, source->run);
+			free(source->page);
+		} else {
+			free(source->rows);
+		}
+	}
+	free(iterator->sources);
+	free(iterator->value);
+	free(iterator);
+}
+
+/* Blocks until the worker has no flush or compaction left to do. */
+void lsm_wait_idle(Lsm* lsm) {
+	pthread_mutex_lock(&lsm->lock);
+	pthread_cond_signal(&lsm->work);
+	while (lsm->frozen != NULL || lsm->busy || lsm_compaction_due(lsm)) {
+		pthread_cond_wait(&lsm->done, &lsm->lock);
+	}
+	pthread_mutex_unlock(&lsm->lock);
+}
+
+uint32_t lsm_num_runs(Lsm* lsm) {
+	pthread_mutex_lock(&lsm->lock);
+	uint32_t num_runs = lsm->num_runs;
+	pthread_mutex_unlock(&lsm->lock);
+	return num_runs;
+}
+
+/* Finishes a pending flush, then stops the worker. The active memtable stays in its log, which is synced. */
+void lsm_close(Lsm* lsm) {
+	pthread_mutex_lock(&lsm->lock);
+	lsm->closing = true;
+	pthread_cond_signal(&lsm->work);
+	pthread_mutex_unlock(&lsm->lock);
+	pthread_join(lsm->worker, NULL);
+
+	sync_or_die(lsm->wal_file_descriptor);
+	close(lsm->wal_file_descriptor);
+	memtable_free(lsm->active);
+	for (uint32_t i = 0; i < lsm->num_runs; i++) {
+		run_release(lsm, lsm->runs[i]);
+	}
+
+	pthread_mutex_destroy(&lsm->lock);
+	pthread_cond_destroy(&lsm->work);
+	pthread_cond_destroy(&lsm->done);
+	free(lsm->filename);
+	free(lsm);
+}
+
+/* Deletes the manifest and every run and log it refers to. The engine must be closed. */
+void lsm_destroy(const char* filename) {
+	Lsm* lsm = calloc(1, sizeof(Lsm));
+	lsm->filename = (char*)filename;
+	pthread_mutex_init(&lsm->lock, NULL);
+
+	if (access(filename, F_OK) == 0) {
+		manifest_load(lsm);
+		char path[LSM_MAX_PATH];
+		for (uint32_t i = 0; i < lsm->num_runs; i++) {
+			lsm->runs[i]->obsolete = true;
+			run_release(lsm, lsm->runs[i]);
+		}
+		for (uint32_t seq = lsm->first_wal_seq; ; seq++) {
+			lsm_path(filename, seq, "wal", path);
+			if (unlink(path) == -1) {
+				break;
+			}
+		}
+		unlink(filename);
+	}
+
+	pthread_mutex_destroy(&lsm->lock);
+	free(lsm);
+}
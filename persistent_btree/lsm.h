@@ -0,0 +1,146 @@
+#ifndef LSM_H
+#define LSM_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "table.h"
+#include "btree.h"
+
+/*
+ * Log-structured engine for write-heavy tables. Puts are appended to a
+ * write-ahead log and land in an in-memory memtable; a full memtable is
+ * frozen and a background worker writes it out as an immutable sorted run
+ * while a fresh memtable takes new puts. The same worker compacts runs,
+ * size-tiered: once the LSM_TIER_FANOUT newest runs share a tier it merges
+ * them into one run of the next tier. Rows use the B-tree's serialization,
+ * and a later put of an id shadows every earlier one; puts never read.
+ *
+ * Files hang off the manifest's name: <name> lists the live runs newest
+ * first and is replaced by rename, <name>.<seq>.run is a run and
+ * <name>.<seq>.wal is the log of one memtable. Opening replays every log
+ * from the manifest's first unflushed one up.
+ *
+ * A put only reaches the OS page cache, so a machine crash can lose recent
+ * puts, though never a row that was already flushed. lsm_sync syncs the
+ * active log, letting callers commit a group of puts with one fsync; a log
+ * is also synced when its memtable is frozen and on close.
+ *
+ * An Lsm is not safe for concurrent writers; the worker only ever touches
+ * the frozen memtable and the run list, under the lock.
+*/
+#define LSM_TIER_FANOUT 4
+#define LSM_MAX_RUNS 64
+
+static const uint32_t LSM_MANIFEST_MAGIC = 0x4d4d534c;
+static const uint32_t LSM_RUN_MAGIC = 0x524d534c;
+
+/*
+ * Manifest Layout
+*/
+static const uint32_t LSM_MANIFEST_MAGIC_OFFSET = 0;
+static const uint32_t LSM_MANIFEST_NEXT_RUN_OFFSET = LSM_MANIFEST_MAGIC_OFFSET + sizeof(uint32_t);
+static const uint32_t LSM_MANIFEST_FIRST_WAL_OFFSET = LSM_MANIFEST_NEXT_RUN_OFFSET + sizeof(uint32_t);
+static const uint32_t LSM_MANIFEST_NUM_RUNS_OFFSET = LSM_MANIFEST_FIRST_WAL_OFFSET + sizeof(uint32_t);
+static const uint32_t LSM_MANIFEST_RUNS_OFFSET = LSM_MANIFEST_NUM_RUNS_OFFSET + sizeof(uint32_t);
+
+/*
+ * Run Layout: a header page, then rows in id order, ROWS_PER_PAGE to a
+ * page, so a get reads exactly one page of a run.
+*/
+static const uint32_t LSM_RUN_MAGIC_OFFSET = 0;
+static const uint32_t LSM_RUN_NUM_ROWS_OFFSET = LSM_RUN_MAGIC_OFFSET + sizeof(uint32_t);
+static const uint32_t LSM_RUN_TIER_OFFSET = LSM_RUN_NUM_ROWS_OFFSET + sizeof(uint32_t);
+
+/*
+ * Rows are kept serialized in arrival order; slots is an open-addressed
+ * index from id to row, so a repeated id overwrites its row in place.
+*/
+typedef struct {
+	uint8_t* rows;
+	uint32_t* slots;
+	uint32_t num_rows;
+	uint32_t capacity;
+	uint32_t mask;
+	uint32_t wal_seq;
+} Memtable;
+
+/* first_ids[p] is the id of the first row on data page p. */
+typedef struct {
+	uint32_t seq;
+	uint32_t tier;
+	int file_descriptor;
+	uint32_t num_rows;
+	uint32_t num_pages;
+	uint64_t* first_ids;
+	uint32_t refs;
+	bool obsolete;
+} LsmRun;
+
+/* runs[0] is the newest. */
+typedef struct {
+	char* filename;
+	uint32_t memtable_rows;
+	Memtable* active;
+	Memtable* frozen;
+	int wal_file_descriptor;
+	uint32_t next_wal_seq;
+	uint32_t first_wal_seq;
+	LsmRun* runs[LSM_MAX_RUNS];
+	uint32_t num_runs;
+	uint32_t next_run_seq;
+	pthread_mutex_t lock;
+	pthread_cond_t work;
+	pthread_cond_t done;
+	pthread_t worker;
+	bool busy;
+	bool closing;
+} Lsm;
+
+/*
+ * A merged iterator over a snapshot: the memtables' rows in range, copied
+ * and sorted when it opens, and a read position in each run it holds a
+ * reference to. Sources are ordered newest first, so where several hold an
+ * id the first one's row is returned. value holds the row last returned.
+*/
+typedef struct {
+	uint8_t* rows;
+	uint32_t num_rows;
+	uint32_t position;
+	LsmRun* run;
+	uint32_t page_num;
+	uint8_t* page;
+} LsmSource;
+
+typedef struct {
+	Lsm* lsm;
+	LsmSource* sources;
+	uint32_t num_sources;
+	uint64_t end_id;
+	uint8_t* value;
+} LsmIterator;
+
+Lsm* lsm_open(const char* filename, uint32_t memtable_rows);
+
+void lsm_put(Lsm* lsm, Row* row);
+
+void lsm_sync(Lsm* lsm);
+
+DbResult lsm_get(Lsm* lsm, uint64_t id, Row* row);
+
+LsmIterator* lsm_scan(Lsm* lsm, uint64_t start_id, uint64_t end_id);
+
+bool lsm_iterator_next(LsmIterator* iterator, Row* row);
+
+void lsm_iterator_close(LsmIterator* iterator);
+
+void lsm_wait_idle(Lsm* lsm);
+
+uint32_t lsm_num_runs(Lsm* lsm);
+
+void lsm_close(Lsm* lsm);
+
+void lsm_destroy(const char* filename);
+
+#endif // LSM_H
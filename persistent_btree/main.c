@@ -6,41 +6,31 @@
 
 #include "table.h"
 #include "node.h"
+#include "scan.h"
+#include "sink.h"
+#include "statement.h"
+#include "stats.h"
+#include "cache.h"
+#include "bloom.h"
+
+#define REPL_MAX_PREPARED 64
+#define REPL_MAX_ROW_CACHE (1 << 20)
 
 typedef enum {
 	META_COMMAND_SUCCESS,
 	META_COMMAND_UNRECOGNIZED_COMMAND
 } MetaCommandResult;
 
-typedef enum {
-	PREPARE_SUCCESS,
-	PREPARE_NEGATIVE_ID,
-	PREPARE_UNRECOGNIZED_COMMAND,
-	PREPARE_STRING_TOO_LONG,
-	PREPARE_SYNTAX_ERROR
-} PrepareResult;
-
-typedef enum {
-	STATEMENT_INSERT,
-	STATEMENT_SELECT
-} StatementType;
-
-typedef enum {
-	EXECUTE_SUCCESS,
-	EXECUTE_TABLE_FULL,
-	EXECUTE_DUPLICATE_KEY
-} ExecuteResult;
-
 typedef struct {
 	char* buffer;
 	size_t buffer_length;
 	size_t input_length;
 } InputBuffer;
 
-typedef struct {
-	StatementType type;
-	Row row_to_insert;
-} Statement;
+static uint32_t scan_threads = 1;
+static SinkFormat output_format = SINK_TEXT;
+static Statement prepared[REPL_MAX_PREPARED];
+static uint32_t num_prepared = 0;
 
 InputBuffer* new_input_buffer() {
 	InputBuffer* input_buffer = (InputBuffer*)malloc(sizeof(InputBuffer));
@@ -73,7 +63,7 @@ void print_tree(Pager* pager, uint32_t page_num, uint32_t indentation_level) {
       printf("- leaf (size %d)\n", num_keys);
       for (uint32_t i = 0; i < num_keys; i++) {
         indent(indentation_level + 1);
-        printf("- %d\n", *leaf_node_key(node, i));
+        printf("- %llu\n", (unsigned long long)key_to_uint64(leaf_node_key(node, i)));
       }
       break;
     case (NODE_INTERNAL):
@@ -86,7 +76,7 @@ void print_tree(Pager* pager, uint32_t page_num, uint32_t indentation_level) {
 			print_tree(pager, child, indentation_level + 1);
 
 			indent(indentation_level + 1);
-			printf("- key %d\n", *internal_node_key(node, i));
+			printf("- key %llu\n", (unsigned long long)key_to_uint64(internal_node_key(node, i)));
 		}
 		child = *internal_node_right_child(node);
 		print_tree(pager, child, indentation_level + 1);
@@ -95,120 +85,128 @@ void print_tree(Pager* pager, uint32_t page_num, uint32_t indentation_level) {
   }
 }
 
-void print_prompt() {
-	printf("db > ");
-}
-
-void read_input(InputBuffer* input_buffer) {
-	size_t bytes_read = getline(&(input_buffer->buffer), &(input_buffer->buffer_length), stdin);
-
-	if (bytes_read <= 0) {
-		printf("Error Reading Input\n");
-		exit(EXIT_FAILURE);
-	}
-
-	input_buffer->input_length = bytes_read - 1;
-	input_buffer->buffer[bytes_read - 1] = 0;
-}
-
-MetaCommandResult do_meta_command(InputBuffer* input_buffer, Table* table){
-	if (strcmp(input_buffer->buffer, ".exit") == 0) {
-		db_close(table);
-		exit(EXIT_SUCCESS);
-	} else if (strcmp(input_buffer->buffer, ".btree") == 0) {
-		print_tree(table->pager, 0, 0);
-		return META_COMMAND_SUCCESS;
-	} else {
-		return META_COMMAND_UNRECOGNIZED_COMMAND;
+/*
+ * `execute N v1, v2, ...` copies prepared statement N and binds the values to
+ * its placeholders in order.
+*/
+PrepareResult bind_prepared(InputBuffer* input_buffer, Statement* statement) {
+	strtok(input_buffer->buffer, " ");
+	char* handle_string = strtok(NULL, " ");
+	if (handle_string == NULL) {
+		return PREPARE_SYNTAX_ERROR;
 	}
-}
 
-PrepareResult prepare_insert(InputBuffer* input_buffer, Statement* statement) {
-	statement->type = STATEMENT_INSERT;
-	
-	char* keyword = strtok(input_buffer->buffer, " ");
-	char* id_string = strtok(NULL, " ");
-	char* username = strtok(NULL, " ");
-	char* email = strtok(NULL, " ");
-
-	if (id_string == NULL || username == NULL || email == NULL) {
+	int handle = atoi(handle_string);
+	if (handle < 1 || (uint32_t)handle > num_prepared) {
 		return PREPARE_SYNTAX_ERROR;
 	}
+	*statement = prepared[handle - 1];
 
-	int id = atoi(id_string);
-	if (id < 0) {
-		return PREPARE_NEGATIVE_ID;
-	}
-	if (strlen(username) > COLUMN_USERNAME_SIZE) {
-		return PREPARE_STRING_TOO_LONG;
-	}
-	if (strlen(email) > COLUMN_EMAIL_SIZE) {
-		return PREPARE_STRING_TOO_LONG;
+	uint32_t index = 0;
+	for (char* value = strtok(NULL, " ,"); value != NULL; value = strtok(NULL, " ,")) {
+		PrepareResult result = statement_bind_text(statement, index++, value);
+		if (result != PREPARE_SUCCESS) {
+			return result;
+		}
 	}
 
-	statement->row_to_insert.id = id;
-	strcpy(statement->row_to_insert.username, username);
-	strcpy(statement->row_to_insert.email, email);
-
 	return PREPARE_SUCCESS;
 }
 
-PrepareResult prepare_statement(InputBuffer* input_buffer, Statement* statement) {
-	if (strncmp(input_buffer->buffer, "insert", 6) == 0) {
-		return prepare_insert(input_buffer, statement);
-	}
-	if (strcmp(input_buffer->buffer, "select") == 0) {
-		statement->type = STATEMENT_SELECT;
-		return PREPARE_SUCCESS;
-	}
-
-	return PREPARE_UNRECOGNIZED_COMMAND;
+void print_prompt() {
+	printf("db > ");
 }
 
-ExecuteResult execute_insert(Statement* statement, Table* table) {
-	void* node = get_page(table->pager, table->root_page_num);
-	uint32_t num_cells = (*leaf_node_num_cells(node));
-
-	Row* row_to_insert = &(statement->row_to_insert);
-    
-	uint32_t key_to_insert = row_to_insert->id;
-	Cursor* cursor = table_find(table, key_to_insert);
+/* Returns false at end of input. */
+bool read_input(InputBuffer* input_buffer) {
+	ssize_t bytes_read = getline(&(input_buffer->buffer), &(input_buffer->buffer_length), stdin);
 
-	if (cursor->cell_num < num_cells) {
-		uint32_t key_at_index = *leaf_node_key(node, cursor->cell_num);
-		if (key_at_index == key_to_insert) {
-			return EXECUTE_DUPLICATE_KEY;
+	if (bytes_read < 0) {
+		if (!feof(stdin)) {
+			printf("Error Reading Input\n");
+			exit(EXIT_FAILURE);
 		}
+		return false;
 	}
 
-	leaf_node_insert(cursor, row_to_insert->id, row_to_insert);
-
-    free(cursor);
-
-	return EXECUTE_SUCCESS;
+	if (bytes_read > 0 && input_buffer->buffer[bytes_read - 1] == '\n') {
+		bytes_read--;
+	}
+	input_buffer->input_length = bytes_read;
+	input_buffer->buffer[bytes_read] = 0;
+	return true;
 }
 
-ExecuteResult execute_select(Statement* statement, Table* table) {
-    Cursor* cursor = table_start(table);
-
-	Row row;
-	while(!(cursor->end_of_table)) {
-		deserialize_row(cursor_value(cursor), &row);
-		printf("(%d, %s, %s)\n", row.id, row.username, row.email);
-        cursor_advance(cursor);
+/*
+ * `.stats` lists the engine counters, the tree height, the statement cache and
+ * latency percentiles; `.stats json` prints the same as one JSON object.
+ * Latencies are histogram bucket bounds in nanoseconds.
+*/
+void print_stats(Table* table, StatementCache* cache, bool json) {
+	Stats stats;
+	stats_read(&stats);
+	uint32_t height = table_height(table);
+
+	if (json) {
+		printf("{");
+		for (uint32_t i = 0; i < STAT_NUM_COUNTERS; i++) {
+			printf("\"%s\": %llu, ", stats_counter_name(i), (unsigned long long)stats.counters[i]);
+		}
+		printf("\"tree_height\": %u, \"statement_cache_hits\": %u, \"statement_cache_misses\": %u",
+			height, cache->hits, cache->misses);
+		for (uint32_t h = 0; h < STAT_NUM_HISTOGRAMS; h++) {
+			const uint64_t* buckets = stats.histograms[h];
+			printf(", \"%s\": {\"count\": %llu, \"p50\": %llu, \"p99\": %llu}", stats_histogram_name(h),
+				(unsigned long long)stats_histogram_count(buckets),
+				(unsigned long long)stats_histogram_percentile(buckets, 0.5),
+				(unsigned long long)stats_histogram_percentile(buckets, 0.99));
+		}
+		printf("}\n");
+		return;
 	}
 
-    free(cursor);
-
-	return EXECUTE_SUCCESS;
+	for (uint32_t i = 0; i < STAT_NUM_COUNTERS; i++) {
+		printf("%-24s %llu\n", stats_counter_name(i), (unsigned long long)stats.counters[i]);
+	}
+	printf("%-24s %u\n", "tree_height", height);
+	printf("%-24s %u\n", "statement_cache_hits", cache->hits);
+	printf("%-24s %u\n", "statement_cache_misses", cache->misses);
+	for (uint32_t h = 0; h < STAT_NUM_HISTOGRAMS; h++) {
+		const uint64_t* buckets = stats.histograms[h];
+		printf("%-24s count %llu, p50 %llu ns, p99 %llu ns\n", stats_histogram_name(h),
+			(unsigned long long)stats_histogram_count(buckets),
+			(unsigned long long)stats_histogram_percentile(buckets, 0.5),
+			(unsigned long long)stats_histogram_percentile(buckets, 0.99));
+	}
 }
 
-ExecuteResult execute_statement(Statement* statement, Table* table) {
-	switch (statement->type) {
-		case (STATEMENT_INSERT):
-			return execute_insert(statement, table);
-		case (STATEMENT_SELECT):
-			return execute_select(statement, table);
+MetaCommandResult do_meta_command(InputBuffer* input_buffer, Table* table, StatementCache* cache){
+	if (strcmp(input_buffer->buffer, ".exit") == 0) {
+		db_close(table);
+		exit(EXIT_SUCCESS);
+	} else if (strcmp(input_buffer->buffer, ".btree") == 0) {
+		print_tree(table->pager, 0, 0);
+		return META_COMMAND_SUCCESS;
+	} else if (strcmp(input_buffer->buffer, ".mode text") == 0) {
+		output_format = SINK_TEXT;
+		return META_COMMAND_SUCCESS;
+	} else if (strcmp(input_buffer->buffer, ".mode csv") == 0) {
+		output_format = SINK_CSV;
+		return META_COMMAND_SUCCESS;
+	} else if (strcmp(input_buffer->buffer, ".mode binary") == 0) {
+		output_format = SINK_BINARY;
+		return META_COMMAND_SUCCESS;
+	} else if (strcmp(input_buffer->buffer, ".bloom") == 0) {
+		bloom_create(table);
+		return META_COMMAND_SUCCESS;
+	} else if (strcmp(input_buffer->buffer, ".stats") == 0) {
+		print_stats(table, cache, false);
+		return META_COMMAND_SUCCESS;
+	} else if (strcmp(input_buffer->buffer, ".stats json") == 0) {
+		print_stats(table, cache, true);
+		return META_COMMAND_SUCCESS;
+	} else {
+		return META_COMMAND_UNRECOGNIZED_COMMAND;
 	}
 }
 
@@ -220,15 +218,42 @@ int main(int argc, char* argv[]){
 	}
 
 	char* filename = argv[1];
-	Table* table = db_open(filename);
+	PagerMode mode = PAGER_IN_PLACE;
+	int row_cache_rows = 0;
+	for (int i = 2; i < argc; i++) {
+		if (strcmp(argv[i], "--cow") == 0) {
+			mode = PAGER_COPY_ON_WRITE;
+		} else if (strcmp(argv[i], "--compress") == 0) {
+			mode = PAGER_COMPRESSED;
+		} else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+			scan_threads = atoi(argv[++i]);
+			if (scan_threads < 1 || scan_threads > SCAN_MAX_WORKERS) {
+				printf("Thread count must be between 1 and %d.\n", SCAN_MAX_WORKERS);
+				exit(EXIT_FAILURE);
+			}
+		} else if (strcmp(argv[i], "--row-cache") == 0 && i + 1 < argc) {
+			row_cache_rows = atoi(argv[++i]);
+			if (row_cache_rows < 1 || row_cache_rows > REPL_MAX_ROW_CACHE) {
+				printf("Row cache size must be between 1 and %d.\n", REPL_MAX_ROW_CACHE);
+				exit(EXIT_FAILURE);
+			}
+		}
+	}
+	Table* table = db_open_mode(filename, mode);
+	if (row_cache_rows > 0) {
+		table->row_cache = row_cache_new(row_cache_rows);
+	}
+	StatementCache* cache = statement_cache_new();
 
 	InputBuffer* input_buffer = new_input_buffer();
 	while (true) {
 		print_prompt();
-		read_input(input_buffer);
+		if (!read_input(input_buffer)) {
+			break;
+		}
 
 		if (input_buffer->buffer[0] == '.') {
-			switch (do_meta_command(input_buffer, table)) {
+			switch (do_meta_command(input_buffer, table, cache)) {
 				case (META_COMMAND_SUCCESS):
 					continue;
 				case (META_COMMAND_UNRECOGNIZED_COMMAND):
@@ -238,7 +263,22 @@ int main(int argc, char* argv[]){
 		}
 
 		Statement statement;
-		switch (prepare_statement(input_buffer, &statement)) {
+		PrepareResult prepare_result;
+		bool prepare_only = false;
+		if (strncmp(input_buffer->buffer, "prepare ", 8) == 0) {
+			if (num_prepared == REPL_MAX_PREPARED) {
+				printf("Error: Too many prepared statements.\n");
+				continue;
+			}
+			prepare_result = statement_cache_prepare(cache, input_buffer->buffer + 8, &statement);
+			prepare_only = true;
+		} else if (strncmp(input_buffer->buffer, "execute ", 8) == 0) {
+			prepare_result = bind_prepared(input_buffer, &statement);
+		} else {
+			prepare_result = statement_cache_prepare(cache, input_buffer->buffer, &statement);
+		}
+
+		switch (prepare_result) {
 			case (PREPARE_SUCCESS):
 				break;
 			case (PREPARE_NEGATIVE_ID):
@@ -253,9 +293,22 @@ int main(int argc, char* argv[]){
 			case (PREPARE_UNRECOGNIZED_COMMAND):
 				printf("Unrecognized keyword at start of '%s'.\n", input_buffer->buffer);
 				continue;
+			case (PREPARE_UNKNOWN_TABLE):
+				printf("Unknown table.\n");
+				continue;
 		}
 
-		switch (execute_statement(&statement, table)) {
+		if (prepare_only) {
+			prepared[num_prepared++] = statement;
+			printf("Prepared statement %d.\n", num_prepared);
+			continue;
+		}
+
+		ResultSink* output = sink_open(output_format, stdout);
+		ExecuteResult execute_result = execute_statement(&statement, table, output, scan_threads);
+		sink_close(output);
+
+		switch (execute_result) {
 			case (EXECUTE_SUCCESS):
 				printf("Executed.\n");
 				break;
@@ -265,8 +318,15 @@ int main(int argc, char* argv[]){
 			case (EXECUTE_DUPLICATE_KEY):
 				printf("Error: Duplicate key.\n");
 				break;
+			case (EXECUTE_UNBOUND_PARAMETER):
+				printf("Error: Unbound parameter.\n");
+				break;
+			case (EXECUTE_INDEX_EXISTS):
+				printf("Error: Index already exists.\n");
+				break;
 		}
 	}
+	statement_cache_free(cache);
 	close_input_buffer(input_buffer);
 	db_close(table);
 	return EXIT_SUCCESS;
@@ -5,25 +5,42 @@
 
 #include "table.h"
 #include "node.h"
+#include "stats.h"
 
 uint32_t* leaf_node_num_cells(void* node) {
     return node + LEAF_NODE_NUM_CELLS_OFFSET;
 }
 
+uint32_t* leaf_node_value_size(void* node) {
+	return node + LEAF_NODE_VALUE_SIZE_OFFSET;
+}
+
+uint32_t leaf_node_cell_size(void* node) {
+	return LEAF_NODE_KEY_SIZE + LEAF_NODE_TXN_SIZE + *leaf_node_value_size(node);
+}
+
+uint32_t leaf_node_max_cells(void* node) {
+	return LEAF_NODE_SPACE_FOR_CELLS / leaf_node_cell_size(node);
+}
+
 void* leaf_node_cell(void* node, uint32_t cell_num) {
-    return node + LEAF_NODE_HEADER_SIZE + cell_num * LEAF_NODE_CELL_SIZE;
+    return node + LEAF_NODE_HEADER_SIZE + cell_num * leaf_node_cell_size(node);
 }
 
 uint32_t* leaf_node_next_leaf(void* node) {
 	return node + LEAF_NODE_NEXT_LEAF_OFFSET;
 }
 
-uint32_t* leaf_node_key(void* node, uint32_t cell_num) {
+Key* leaf_node_key(void* node, uint32_t cell_num) {
     return leaf_node_cell(node, cell_num);
 }
 
+uint32_t* leaf_node_txn(void* node, uint32_t cell_num) {
+	return leaf_node_cell(node, cell_num) + LEAF_NODE_TXN_OFFSET;
+}
+
 void* leaf_node_value(void* node, uint32_t cell_num) {
-    return leaf_node_cell(node, cell_num) + LEAF_NODE_KEY_SIZE;
+    return leaf_node_cell(node, cell_num) + LEAF_NODE_VALUE_OFFSET;
 }
 
 uint32_t* internal_node_num_keys(void* node) {
@@ -60,10 +77,105 @@ uint32_t* internal_node_child(void* node, uint32_t child_num) {
 	}
 }
 
-uint32_t* internal_node_key(void* node, uint32_t key_num) {
+Key* internal_node_key(void* node, uint32_t key_num) {
 	return (void*)internal_node_cell(node, key_num) + INTERNAL_NODE_CHILD_SIZE;
 }
 
+uint32_t* internal_node_right_count(void* node) {
+	return node + INTERNAL_NODE_RIGHT_COUNT_OFFSET;
+}
+
+uint32_t* internal_node_child_count(void* node, uint32_t child_num) {
+	if (child_num == *internal_node_num_keys(node)) {
+		return internal_node_right_count(node);
+	}
+	return (void*)internal_node_cell(node, child_num) + INTERNAL_NODE_CHILD_SIZE + INTERNAL_NODE_KEY_SIZE;
+}
+
+Key* internal_node_low_fence(void* node) {
+	return node + INTERNAL_NODE_LOW_FENCE_OFFSET;
+}
+
+Key* internal_node_high_fence(void* node) {
+	return node + INTERNAL_NODE_HIGH_FENCE_OFFSET;
+}
+
+/* Extends an internal node's fences to cover [low, high]. */
+static void widen_fences(void* node, const Key* low, const Key* high) {
+	if (key_compare(low, internal_node_low_fence(node)) < 0) {
+		*internal_node_low_fence(node) = *low;
+	}
+	if (key_compare(high, internal_node_high_fence(node)) > 0) {
+		*internal_node_high_fence(node) = *high;
+	}
+}
+
+/* Recomputes an internal node's fences from its first and right children. */
+static void refresh_fences(Pager* pager, void* node) {
+	*internal_node_low_fence(node) = get_node_min_key(peek_page(pager, *internal_node_child(node, 0)));
+	*internal_node_high_fence(node) = get_node_max_key(peek_page(pager, *internal_node_right_child(node)));
+}
+
+uint32_t node_row_count(void* node) {
+	if (get_node_type(node) == NODE_LEAF) {
+		return *leaf_node_num_cells(node);
+	}
+
+	uint32_t num_keys = *internal_node_num_keys(node);
+	uint32_t count = 0;
+	for (uint32_t i = 0; i < num_keys; i++) {
+		count += *internal_node_child_count(node, i);
+	}
+	if (*internal_node_right_child(node) != INVALID_PAGE_NUM) {
+		count += *internal_node_right_count(node);
+	}
+	return count;
+}
+
+/*
+ * Rewrites the separator after child_num as the shortest key that still
+ * divides it from its right neighbour, so descents compare fewer bytes.
+*/
+static void truncate_separator(Pager* pager, void* parent, uint32_t child_num) {
+	if (child_num >= *internal_node_num_keys(parent)) {
+		return;
+	}
+
+	Key left_max = get_node_max_key(peek_page(pager, *internal_node_child(parent, child_num)));
+	Key right_min = get_node_min_key(peek_page(pager, *internal_node_child(parent, child_num + 1)));
+	key_separator(&left_max, &right_min, internal_node_key(parent, child_num));
+}
+
+static void refresh_subtree(Pager* pager, uint32_t page_num) {
+	void* node = get_page(pager, page_num);
+	if (get_node_type(node) == NODE_LEAF) {
+		return;
+	}
+
+	uint32_t num_keys = *internal_node_num_keys(node);
+	for (uint32_t i = 0; i <= num_keys; i++) {
+		uint32_t child_page_num = i == num_keys ? *internal_node_right_child(node) : *internal_node_cell(node, i);
+		if (!pager_in_write_set(pager, child_page_num)) {
+			continue;
+		}
+		refresh_subtree(pager, child_page_num);
+		*internal_node_child_count(node, i) = node_row_count(get_page(pager, child_page_num));
+		truncate_separator(pager, node, i);
+	}
+}
+
+/*
+ * Descends from the root through the pages written in the current
+ * transaction, rewriting each parent's count for every written child and
+ * the separator that follows it, children first. Any node whose subtree
+ * gained or lost rows was written, and so was every node above it, so
+ * every changed count is reached. Separators are set to full max keys by
+ * splits and shortened here once the tree is consistent again.
+*/
+void refresh_internal_cells(Table* table) {
+	refresh_subtree(table->pager, table->root_page_num);
+}
+
 bool is_node_root(void* node) {
 	uint8_t value = *((uint8_t*)(node + IS_ROOT_OFFSET));
 	return (bool)value;
@@ -84,17 +196,28 @@ void set_node_type(void* node, NodeType type) {
 	*((uint8_t*)(node + NODE_TYPE_OFFSET)) = value;
 }
 
-uint32_t get_node_max_key(Pager* pager, void* node) {
+Key get_node_max_key(void* node) {
 	if (get_node_type(node) == NODE_LEAF) {
 		return *leaf_node_key(node, *leaf_node_num_cells(node) - 1);
 	}
-	void* right_child = get_page(pager, *internal_node_right_child(node));
-	return get_node_max_key(pager, right_child);
+	return *internal_node_high_fence(node);
+}
+
+Key get_node_min_key(void* node) {
+	if (get_node_type(node) == NODE_LEAF) {
+		return *leaf_node_key(node, 0);
+	}
+	return *internal_node_low_fence(node);
 }
 
-uint32_t* node_parent(void* node) { return node + PARENT_POINTER_OFFSET; }
+/*
+ * Id of the last transaction that wrote this node. Cursors compare it against
+ * the value they saw when positioning to detect a leaf rewritten under them.
+ * The root's copy doubles as the table's commit counter across reopens.
+*/
+uint32_t* node_txn(void* node) { return node + NODE_TXN_OFFSET; }
 
-uint32_t internal_node_find_child(void* node, uint32_t key) {
+uint32_t internal_node_find_child(void* node, const Key* key) {
 
 	uint32_t num_keys = *internal_node_num_keys(node);
 
@@ -103,8 +226,7 @@ uint32_t internal_node_find_child(void* node, uint32_t key) {
 
 	while (min_index != max_index) {
 		uint32_t index = (min_index + max_index) / 2;
-		uint32_t key_to_right = *internal_node_key(node, index);
-		if (key_to_right >= key) {
+		if (key_compare(internal_node_key(node, index), key) >= 0) {
 			max_index = index;
 		} else {
 			min_index = index + 1;
@@ -114,124 +236,151 @@ uint32_t internal_node_find_child(void* node, uint32_t key) {
 	return min_index;
 }
 
-void internal_node_insert(Table* table, uint32_t parent_page_num, uint32_t child_page_num) {
-	void* parent = get_page(table->pager, parent_page_num);
-	void* child = get_page(table->pager, child_page_num);
-	uint32_t child_max_key = get_node_max_key(table->pager, child);
-	uint32_t index = internal_node_find_child(parent, child_max_key);
+/* Adds a child to an internal node with room for it. */
+static void internal_node_add_child(Pager* pager, uint32_t parent_page_num, uint32_t child_page_num) {
+	void* parent = get_page(pager, parent_page_num);
+	void* child = get_page(pager, child_page_num);
+	Key child_max_key = get_node_max_key(child);
+	uint32_t index = internal_node_find_child(parent, &child_max_key);
 
 	uint32_t original_num_keys = *internal_node_num_keys(parent);
 
-	if (original_num_keys >= INTERNAL_NODE_MAX_CELLS) {
-		internal_node_split_and_insert(table, parent_page_num, child_page_num);
-		return;
-	}
-
+	Key child_min_key = get_node_min_key(child);
 	uint32_t right_child_page_num = *internal_node_right_child(parent);
 	if (right_child_page_num == INVALID_PAGE_NUM) {
 		*internal_node_right_child(parent) = child_page_num;
+		*internal_node_right_count(parent) = node_row_count(child);
+		*internal_node_low_fence(parent) = child_min_key;
+		*internal_node_high_fence(parent) = child_max_key;
 		return;
 	}
-	void* right_child = get_page(table->pager, right_child_page_num);
+	widen_fences(parent, &child_min_key, &child_max_key);
+	void* right_child = peek_page(pager, right_child_page_num);
+	uint32_t right_count = *internal_node_right_count(parent);
 	*internal_node_num_keys(parent) = original_num_keys + 1;
 
-	if (child_max_key > get_node_max_key(table->pager, right_child)) {
-		*internal_node_child(parent, original_num_keys) = right_child_page_num;
-		*internal_node_key(parent, original_num_keys) = get_node_max_key(table->pager, right_child);
+	Key right_max_key = get_node_max_key(right_child);
+	if (key_compare(&child_max_key, &right_max_key) > 0) {
+		/* Written through the cell: internal_node_child rejects the stale slot. */
+		*internal_node_cell(parent, original_num_keys) = right_child_page_num;
+		*internal_node_key(parent, original_num_keys) = right_max_key;
+		*internal_node_child_count(parent, original_num_keys) = right_count;
 		*internal_node_right_child(parent) = child_page_num;
+		*internal_node_right_count(parent) = node_row_count(child);
 	} else {
 		for (uint32_t i = original_num_keys; i > index; i--) {
 			void* destination = internal_node_cell(parent, i);
 			void* source = internal_node_cell(parent, i - 1);
 			memcpy(destination, source, INTERNAL_NODE_CELL_SIZE);
 		}
-		*internal_node_child(parent, index) = child_page_num;
+		*internal_node_cell(parent, index) = child_page_num;
 		*internal_node_key(parent, index) = child_max_key;
+		*internal_node_child_count(parent, index) = node_row_count(child);
 	}
 }
 
-void internal_node_split_and_insert(Table* table, uint32_t parent_page_num, uint32_t child_page_num) {
-
-	uint32_t old_page_num = parent_page_num;
-	void* old_node = get_page(table->pager, parent_page_num);
-	uint32_t old_max = get_node_max_key(table->pager, old_node);
-
-	void* child = get_page(table->pager, child_page_num);
-	uint32_t child_max = get_node_max_key(table->pager, child);
+/* Adds a child to path[level], splitting it first if it is full. */
+void internal_node_insert(Table* table, const uint32_t* path, uint32_t level, uint32_t child_page_num) {
+	void* parent = get_page(table->pager, path[level]);
+	if (*internal_node_num_keys(parent) >= INTERNAL_NODE_MAX_CELLS) {
+		internal_node_split_and_insert(table, path, level, child_page_num);
+		return;
+	}
 
-	uint32_t new_page_num = get_unused_page_num(table->pager);
+	internal_node_add_child(table->pager, path[level], child_page_num);
+}
 
-	uint32_t splitting_root = is_node_root(old_node);
+/*
+ * Moves the upper half of path[level]'s cells and its right child into a
+ * new sibling, adds the child to whichever half it belongs in, and inserts
+ * the sibling one level up. Cells move whole, counts included, so no child
+ * page is read or written and a split dirties only the two halves and the
+ * parent.
+*/
+void internal_node_split_and_insert(Table* table, const uint32_t* path, uint32_t level, uint32_t child_page_num) {
+	stats_add(STAT_INTERNAL_SPLITS, 1);
+	Pager* pager = table->pager;
+
+	uint32_t old_page_num = path[level];
+	void* old_node = get_page(pager, old_page_num);
+	Key old_max = get_node_max_key(old_node);
+	Key child_max = get_node_max_key(get_page(pager, child_page_num));
+
+	uint32_t new_page_num = get_unused_page_num(pager);
+	bool splitting_root = is_node_root(old_node);
 
 	void* parent;
 	void* new_node;
 	if (splitting_root) {
 		create_new_root(table, new_page_num);
-		parent = get_page(table->pager, table->root_page_num);
+		parent = get_page(pager, table->root_page_num);
 
 		old_page_num = *internal_node_child(parent, 0);
-		old_node = get_page(table->pager, old_page_num);
+		old_node = get_page(pager, old_page_num);
+		new_node = get_page(pager, new_page_num);
 	} else {
-		parent = get_page(table->pager, *node_parent(old_node));
-		new_node = get_page(table->pager, new_page_num);
+		parent = get_page(pager, path[level - 1]);
+		new_node = get_page(pager, new_page_num);
 		initialize_internal_node(new_node);
 	}
 
-	uint32_t* old_num_keys = internal_node_num_keys(old_node);
-
-	uint32_t cur_page_num = *internal_node_right_child(old_node);
-	void* cur = get_page(table->pager, cur_page_num);
+	uint32_t num_keys = *internal_node_num_keys(old_node);
+	uint32_t split_index = num_keys / 2;
+	uint32_t num_moved = num_keys - split_index - 1;
 
-	internal_node_insert(table, new_page_num, cur_page_num);
-	*node_parent(cur) = new_page_num;
-	*internal_node_right_child(old_node) = INVALID_PAGE_NUM;
+	memcpy(internal_node_cell(new_node, 0), internal_node_cell(old_node, split_index + 1), num_moved * INTERNAL_NODE_CELL_SIZE);
+	*internal_node_num_keys(new_node) = num_moved;
+	*internal_node_right_child(new_node) = *internal_node_right_child(old_node);
+	*internal_node_right_count(new_node) = *internal_node_right_count(old_node);
 
-	for (int i = INTERNAL_NODE_MAX_CELLS - 1; i > INTERNAL_NODE_MAX_CELLS / 2; i--) {
-		cur_page_num = *internal_node_child(old_node, i);
-		cur = get_page(table->pager, cur_page_num);
-
-		internal_node_insert(table, new_page_num, cur_page_num);
-		*node_parent(cur) = new_page_num;
-
-		(*old_num_keys)--;
-	}
+	*internal_node_right_child(old_node) = *internal_node_cell(old_node, split_index);
+	*internal_node_right_count(old_node) = *internal_node_child_count(old_node, split_index);
+	*internal_node_num_keys(old_node) = split_index;
 
-	*internal_node_right_child(old_node) = *internal_node_child(old_node, *old_num_keys - 1);
-	(*old_num_keys)--;
+	refresh_fences(pager, old_node);
+	refresh_fences(pager, new_node);
 
-	uint32_t max_after_split = get_node_max_key(table->pager, old_node);
+	Key max_after_split = get_node_max_key(old_node);
+	uint32_t destination_page_num = key_compare(&child_max, &max_after_split) < 0 ? old_page_num : new_page_num;
+	internal_node_add_child(pager, destination_page_num, child_page_num);
 
-	uint32_t destination_page_num = child_max < max_after_split ? old_page_num : new_page_num;
+	Key new_max = get_node_max_key(old_node);
+	update_internal_node_key(parent, &old_max, &new_max);
 
-	internal_node_insert(table, destination_page_num, child_page_num);
-	*node_parent(child) = destination_page_num;
-
-	update_internal_node_key(parent, old_max, get_node_max_key(table->pager, old_node));
-
-	if (!splitting_root) {
-		internal_node_insert(table, *node_parent(old_node), new_page_num);
-		*node_parent(new_node) = *node_parent(old_node);
+	/* create_new_root ran while the new node was still empty. */
+	if (splitting_root) {
+		refresh_fences(pager, parent);
+	} else {
+		internal_node_insert(table, path, level - 1, new_page_num);
 	}
-
 }
 
-void update_internal_node_key(void* node, uint32_t old_key, uint32_t new_key){
+void update_internal_node_key(void* node, const Key* old_key, const Key* new_key){
 	uint32_t old_child_index = internal_node_find_child(node, old_key);
-	*internal_node_key(node, old_child_index) = new_key;
+	/* The right child has no separator of its own. */
+	if (old_child_index < *internal_node_num_keys(node)) {
+		*internal_node_key(node, old_child_index) = *new_key;
+	}
 }
 
-void initialize_leaf_node(void* node) {
+void initialize_leaf_node(void* node, uint32_t value_size) {
 	set_node_type(node, NODE_LEAF);
 	set_node_root(node, false);
+	*node_txn(node) = 0;
     *leaf_node_num_cells(node) = 0;
 	*leaf_node_next_leaf(node) = 0;
+	*leaf_node_value_size(node) = value_size;
 }
 
 void initialize_internal_node(void* node) {
 	set_node_type(node, NODE_INTERNAL);
 	set_node_root(node, false);
+	*node_txn(node) = 0;
 	*internal_node_num_keys(node) = 0;
 	*internal_node_right_child(node) = INVALID_PAGE_NUM;
+	*internal_node_right_count(node) = 0;
+	key_init(internal_node_low_fence(node));
+	key_init(internal_node_high_fence(node));
 }
 
 void create_new_root(Table* table, uint32_t right_child_page_num) {
@@ -240,83 +389,141 @@ void create_new_root(Table* table, uint32_t right_child_page_num) {
 	uint32_t left_child_page_num = get_unused_page_num(table->pager);
 	void* left_child = get_page(table->pager, left_child_page_num);
 
+	if (get_node_type(root) == NODE_INTERNAL) {
+		initialize_internal_node(right_child);
+		initialize_internal_node(left_child);
+	}
+
 	memcpy(left_child, root, PAGE_SIZE);
 	set_node_root(left_child, false);
 
 	initialize_internal_node(root);
 	set_node_root(root, true);
 	*internal_node_num_keys(root) = 1;
-	*internal_node_child(root, 0) = left_child_page_num;
-	uint32_t left_child_max_key = get_node_max_key(table->pager, left_child);
-	*internal_node_key(root, 0) = left_child_max_key;
+	*internal_node_cell(root, 0) = left_child_page_num;
+	*internal_node_key(root, 0) = get_node_max_key(left_child);
+	*internal_node_child_count(root, 0) = node_row_count(left_child);
 	*internal_node_right_child(root) = right_child_page_num;
-	*node_parent(left_child) = table->root_page_num;
-	*node_parent(right_child) = table->root_page_num;
+	*internal_node_right_count(root) = node_row_count(right_child);
+	*internal_node_low_fence(root) = get_node_min_key(left_child);
+	*internal_node_high_fence(root) = get_node_max_key(right_child);
+}
+
+/* Writes value into the cell, unless the leaf's cells hold keys only. */
+static void leaf_node_store_value(void* node, uint32_t cell_num, Row* value) {
+	if (*leaf_node_value_size(node) != 0) {
+		serialize_row(value, leaf_node_value(node, cell_num));
+	}
 }
 
-void leaf_node_split_and_insert(Cursor* cursor, uint32_t key, Row* value) {
+void leaf_node_split_and_insert(Cursor* cursor, const Key* key, Row* value) {
+	stats_add(STAT_LEAF_SPLITS, 1);
 	void* old_node = get_page(cursor->table->pager, cursor->page_num);
-	uint32_t old_max = get_node_max_key(cursor->table->pager, old_node);
+	Key old_max = get_node_max_key(old_node);
+	uint32_t cell_size = leaf_node_cell_size(old_node);
+	uint32_t max_cells = leaf_node_max_cells(old_node);
+	uint32_t right_split_count = (max_cells + 1) / 2;
+	uint32_t left_split_count = (max_cells + 1) - right_split_count;
+
 	uint32_t new_page_num = get_unused_page_num(cursor->table->pager);
 	void* new_node = get_page(cursor->table->pager, new_page_num);
-	initialize_leaf_node(new_node);
-	*node_parent(new_node) = *node_parent(old_node);
+	initialize_leaf_node(new_node, *leaf_node_value_size(old_node));
 	*leaf_node_next_leaf(new_node) = *leaf_node_next_leaf(old_node);
 	*leaf_node_next_leaf(old_node) = new_page_num;
 
-	for (int32_t i = LEAF_NODE_MAX_CELLS; i >= 0; i--) {
+	for (int32_t i = max_cells; i >= 0; i--) {
 		void* destination_node;
-		if (i >= LEAF_NODE_LEFT_SPLIT_COUNT) {
+		if (i >= (int32_t)left_split_count) {
 			destination_node = new_node;
 		} else {
 			destination_node = old_node;
 		}
-		uint32_t index_within_node = i % LEAF_NODE_LEFT_SPLIT_COUNT;
+		uint32_t index_within_node = i % left_split_count;
 		void* destination = leaf_node_cell(destination_node, index_within_node);
 
-		if (i == cursor->cell_num) {
-			serialize_row(value, destination);
-			serialize_row(value, leaf_node_value(destination_node, index_within_node));
-			*leaf_node_key(destination_node, index_within_node) = key;
-		} else if (i > cursor->cell_num) {
-			memcpy(destination, leaf_node_cell(old_node, i - 1), LEAF_NODE_CELL_SIZE);
+		if (i == (int32_t)cursor->cell_num) {
+			leaf_node_store_value(destination_node, index_within_node, value);
+			*leaf_node_key(destination_node, index_within_node) = *key;
+			*leaf_node_txn(destination_node, index_within_node) = cursor->table->txn;
+		} else if (i > (int32_t)cursor->cell_num) {
+			memcpy(destination, leaf_node_cell(old_node, i - 1), cell_size);
 		} else {
-			memcpy(destination, leaf_node_cell(old_node, i), LEAF_NODE_CELL_SIZE);
+			memcpy(destination, leaf_node_cell(old_node, i), cell_size);
 		}
 	}
 
-	*(leaf_node_num_cells(old_node)) = LEAF_NODE_LEFT_SPLIT_COUNT;
-	*(leaf_node_num_cells(new_node)) = LEAF_NODE_RIGHT_SPLIT_COUNT;
+	*(leaf_node_num_cells(old_node)) = left_split_count;
+	*(leaf_node_num_cells(new_node)) = right_split_count;
+	*node_txn(old_node) = cursor->table->txn;
+	*node_txn(new_node) = cursor->table->txn;
 
 	if (is_node_root(old_node)) {
 		return create_new_root(cursor->table, new_page_num);
 	} else {
-		uint32_t parent_page_num = *node_parent(old_node);
-		uint32_t new_max = get_node_max_key(cursor->table->pager, old_node);
-		void* parent = get_page(cursor->table->pager, parent_page_num);
+		Key new_max = get_node_max_key(old_node);
+		void* parent = get_page(cursor->table->pager, cursor->path[cursor->depth - 1]);
 
-		update_internal_node_key(parent, old_max, new_max);
-		internal_node_insert(cursor->table, parent_page_num, new_page_num);
+		update_internal_node_key(parent, &old_max, &new_max);
+		internal_node_insert(cursor->table, cursor->path, cursor->depth - 1, new_page_num);
 		return;
 	}
 }
 
-void leaf_node_insert(Cursor* cursor, uint32_t key, Row* value) {
-	void* node = get_page(cursor->table->pager, cursor->page_num);
-	
+void leaf_node_insert(Cursor* cursor, const Key* key, Row* value) {
+	Table* table = cursor->table;
+	table_begin_write(table);
+	void* node = get_page(table->pager, cursor->page_num);
+
+	for (uint32_t level = 0; level < cursor->depth; level++) {
+		widen_fences(get_page(table->pager, cursor->path[level]), key, key);
+	}
+
 	uint32_t num_cells = *leaf_node_num_cells(node);
-	if (num_cells >= LEAF_NODE_MAX_CELLS) {
+	if (num_cells >= leaf_node_max_cells(node)) {
 		leaf_node_split_and_insert(cursor, key, value);
-		return;
+	} else {
+		if (cursor->cell_num < num_cells) {
+			for (uint32_t i = num_cells; i > cursor->cell_num; i--) {
+				memcpy(leaf_node_cell(node, i), leaf_node_cell(node, i - 1), leaf_node_cell_size(node));
+			}
+		}
+
+		*(leaf_node_num_cells(node)) += 1;
+		*(leaf_node_key(node, cursor->cell_num)) = *key;
+		*(leaf_node_txn(node, cursor->cell_num)) = table->txn;
+		leaf_node_store_value(node, cursor->cell_num, value);
+		*node_txn(node) = table->txn;
 	}
 
-	if (cursor->cell_num < num_cells) {
-		for (uint32_t i = num_cells; i > cursor->cell_num; i--) {
-			memcpy(leaf_node_cell(node, i), leaf_node_cell(node, i - 1), LEAF_NODE_CELL_SIZE);
-		}
+	refresh_internal_cells(table);
+	table_commit(table);
+}
+
+/*
+ * Removes the cell under cursor. Leaves are never merged or unlinked, and
+ * an empty one would have no keys to bound it by, so the last cell of a
+ * non-root leaf is kept and stamped LEAF_NODE_DELETED_TXN instead.
+*/
+void leaf_node_delete(Cursor* cursor) {
+	Table* table = cursor->table;
+	table_begin_write(table);
+	void* node = get_page(table->pager, cursor->page_num);
+
+	uint32_t num_cells = *leaf_node_num_cells(node);
+	if (num_cells == 1 && !is_node_root(node)) {
+		*leaf_node_txn(node, cursor->cell_num) = LEAF_NODE_DELETED_TXN;
+	} else {
+		uint32_t num_moved = num_cells - cursor->cell_num - 1;
+		memmove(leaf_node_cell(node, cursor->cell_num), leaf_node_cell(node, cursor->cell_num + 1), num_moved * leaf_node_cell_size(node));
+		*leaf_node_num_cells(node) -= 1;
 	}
+	*node_txn(node) = table->txn;
 
-	*(leaf_node_num_cells(node)) += 1;
-	*(leaf_node_key(node, cursor->cell_num)) = key;
-	serialize_row(value, leaf_node_value(node, cursor->cell_num));
-}
\ No newline at end of file
+	/* Joins the path to the write set so refresh_internal_cells recounts it. */
+	for (uint32_t level = 0; level < cursor->depth; level++) {
+		get_page(table->pager, cursor->path[level]);
+	}
+
+	refresh_internal_cells(table);
+	table_commit(table);
+}
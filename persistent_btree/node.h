@@ -5,6 +5,7 @@
 #include <stdbool.h>
 
 #include "table.h"
+#include "key.h"
 
 typedef enum {
     NODE_INTERNAL,
@@ -18,9 +19,9 @@ static const uint32_t NODE_TYPE_SIZE = sizeof(uint8_t);
 static const uint32_t NODE_TYPE_OFFSET = 0;
 static const uint32_t IS_ROOT_SIZE = sizeof(uint8_t);
 static const uint32_t IS_ROOT_OFFSET = NODE_TYPE_SIZE;
-static const uint32_t PARENT_POINTER_SIZE = sizeof(uint32_t);
-static const uint32_t PARENT_POINTER_OFFSET = IS_ROOT_OFFSET + IS_ROOT_SIZE;
-static const uint8_t COMMON_NODE_HEADER_SIZE = NODE_TYPE_SIZE + IS_ROOT_SIZE + PARENT_POINTER_SIZE;
+static const uint32_t NODE_TXN_SIZE = sizeof(uint32_t);
+static const uint32_t NODE_TXN_OFFSET = IS_ROOT_OFFSET + IS_ROOT_SIZE;
+static const uint8_t COMMON_NODE_HEADER_SIZE = NODE_TYPE_SIZE + IS_ROOT_SIZE + NODE_TXN_SIZE;
 
 /*
  * Leaf Node Header Layout
@@ -29,21 +30,35 @@ static const uint32_t LEAF_NODE_NUM_CELLS_SIZE = sizeof(uint32_t);
 static const uint32_t LEAF_NODE_NUM_CELLS_OFFSET = COMMON_NODE_HEADER_SIZE;
 static const uint32_t LEAF_NODE_NEXT_LEAF_SIZE = sizeof(uint32_t);
 static const uint32_t LEAF_NODE_NEXT_LEAF_OFFSET = LEAF_NODE_NUM_CELLS_OFFSET + LEAF_NODE_NUM_CELLS_SIZE;
-static const uint32_t LEAF_NODE_HEADER_SIZE = COMMON_NODE_HEADER_SIZE + LEAF_NODE_NUM_CELLS_SIZE + LEAF_NODE_NEXT_LEAF_SIZE;
+static const uint32_t LEAF_NODE_VALUE_SIZE_SIZE = sizeof(uint32_t);
+static const uint32_t LEAF_NODE_VALUE_SIZE_OFFSET = LEAF_NODE_NEXT_LEAF_OFFSET + LEAF_NODE_NEXT_LEAF_SIZE;
+static const uint32_t LEAF_NODE_HEADER_SIZE = COMMON_NODE_HEADER_SIZE + LEAF_NODE_NUM_CELLS_SIZE + LEAF_NODE_NEXT_LEAF_SIZE + LEAF_NODE_VALUE_SIZE_SIZE;
 
 /*
- * Leaf Node Body Layout
+ * Catalog: the tail of page 0 holds the root page of each secondary index,
+ * one slot per string column, then the Bloom filter's header page, 0
+ * meaning none. Leaf cells stop short of it, and neither node initializer
+ * touches it.
 */
-static const uint32_t LEAF_NODE_KEY_SIZE = sizeof(uint32_t);
+static const uint32_t CATALOG_SIZE = 3 * sizeof(uint32_t);
+static const uint32_t CATALOG_OFFSET = PAGE_SIZE - CATALOG_SIZE;
+static const uint32_t CATALOG_BLOOM_OFFSET = CATALOG_OFFSET + 2 * sizeof(uint32_t);
+
+/*
+ * Leaf Node Body Layout: cells are key | txn | value, where the value is
+ * the leaf's value size in bytes, ROW_SIZE in a table and 0 in a secondary
+ * index, whose keys already carry the id. A leaf's cell size, and with it
+ * how many cells fit, follows from its value size.
+*/
+static const uint32_t LEAF_NODE_KEY_SIZE = sizeof(Key);
 static const uint32_t LEAF_NODE_KEY_OFFSET = 0;
-static const uint32_t LEAF_NODE_VALUE_SIZE = ROW_SIZE;
-static const uint32_t LEAF_NODE_VALUE_OFFSET = LEAF_NODE_KEY_OFFSET + LEAF_NODE_KEY_SIZE;
-static const uint32_t LEAF_NODE_CELL_SIZE = LEAF_NODE_KEY_SIZE + LEAF_NODE_VALUE_SIZE;
-static const uint32_t LEAF_NODE_SPACE_FOR_CELLS = PAGE_SIZE - LEAF_NODE_HEADER_SIZE;
-static const uint32_t LEAF_NODE_MAX_CELLS = LEAF_NODE_SPACE_FOR_CELLS / LEAF_NODE_CELL_SIZE;
+static const uint32_t LEAF_NODE_TXN_SIZE = sizeof(uint32_t);
+static const uint32_t LEAF_NODE_TXN_OFFSET = LEAF_NODE_KEY_OFFSET + LEAF_NODE_KEY_SIZE;
+static const uint32_t LEAF_NODE_VALUE_OFFSET = LEAF_NODE_TXN_OFFSET + LEAF_NODE_TXN_SIZE;
+static const uint32_t LEAF_NODE_SPACE_FOR_CELLS = PAGE_SIZE - LEAF_NODE_HEADER_SIZE - CATALOG_SIZE;
 
-static const uint32_t LEAF_NODE_RIGHT_SPLIT_COUNT = (LEAF_NODE_MAX_CELLS + 1) / 2;
-static const uint32_t LEAF_NODE_LEFT_SPLIT_COUNT = (LEAF_NODE_MAX_CELLS + 1) - LEAF_NODE_RIGHT_SPLIT_COUNT;
+/* Txn of a deleted cell kept in place, newer than any snapshot. */
+static const uint32_t LEAF_NODE_DELETED_TXN = UINT32_MAX;
 
 /*
  * Internal Node Body Layout
@@ -53,20 +68,50 @@ static const uint32_t INTERNAL_NODE_NUM_KEYS_SIZE = sizeof(uint32_t);
 static const uint32_t INTERNAL_NODE_NUM_KEYS_OFFSET = COMMON_NODE_HEADER_SIZE;
 static const uint32_t INTERNAL_NODE_RIGHT_CHILD_SIZE = sizeof(uint32_t);
 static const uint32_t INTERNAL_NODE_RIGHT_CHILD_OFFSET = INTERNAL_NODE_NUM_KEYS_OFFSET + INTERNAL_NODE_NUM_KEYS_SIZE;
-static const uint32_t INTERNAL_NODE_HEADER_SIZE = COMMON_NODE_HEADER_SIZE + INTERNAL_NODE_NUM_KEYS_SIZE + INTERNAL_NODE_RIGHT_CHILD_SIZE;
+static const uint32_t INTERNAL_NODE_RIGHT_COUNT_SIZE = sizeof(uint32_t);
+static const uint32_t INTERNAL_NODE_RIGHT_COUNT_OFFSET = INTERNAL_NODE_RIGHT_CHILD_OFFSET + INTERNAL_NODE_RIGHT_CHILD_SIZE;
+static const uint32_t INTERNAL_NODE_FENCE_SIZE = sizeof(Key);
+static const uint32_t INTERNAL_NODE_LOW_FENCE_OFFSET = INTERNAL_NODE_RIGHT_COUNT_OFFSET + INTERNAL_NODE_RIGHT_COUNT_SIZE;
+static const uint32_t INTERNAL_NODE_HIGH_FENCE_OFFSET = INTERNAL_NODE_LOW_FENCE_OFFSET + INTERNAL_NODE_FENCE_SIZE;
+static const uint32_t INTERNAL_NODE_HEADER_SIZE = COMMON_NODE_HEADER_SIZE + INTERNAL_NODE_NUM_KEYS_SIZE + INTERNAL_NODE_RIGHT_CHILD_SIZE + INTERNAL_NODE_RIGHT_COUNT_SIZE + 2 * INTERNAL_NODE_FENCE_SIZE;
+
+/*
+ * Fence keys: the smallest and largest key stored in the subtree, so min and
+ * max queries on an internal node read its header instead of walking a
+ * spine. A leaf's fences are its first and last cells. Inserts widen every
+ * ancestor's fences before the leaf changes; splits reset the fences of the
+ * internal nodes they divide.
+*/
 
-static const uint32_t INTERNAL_NODE_KEY_SIZE = sizeof(uint32_t);
+/*
+ * Internal cells are child | key | count, where count is the number of rows
+ * in the child's subtree. The right child's count lives in the header. A
+ * separator is at least the max key of the child before it and below every
+ * key of the child after it; it need not be a key that exists. Cells fill
+ * the page up to the catalog, since page 0 may be internal.
+*/
+static const uint32_t INTERNAL_NODE_KEY_SIZE = sizeof(Key);
 static const uint32_t INTERNAL_NODE_CHILD_SIZE = sizeof(uint32_t);
-static const uint32_t INTERNAL_NODE_CELL_SIZE = INTERNAL_NODE_CHILD_SIZE + INTERNAL_NODE_KEY_SIZE;
-static const uint32_t INTERNAL_NODE_MAX_CELLS = 3;
+static const uint32_t INTERNAL_NODE_COUNT_SIZE = sizeof(uint32_t);
+static const uint32_t INTERNAL_NODE_CELL_SIZE = INTERNAL_NODE_CHILD_SIZE + INTERNAL_NODE_KEY_SIZE + INTERNAL_NODE_COUNT_SIZE;
+static const uint32_t INTERNAL_NODE_SPACE_FOR_CELLS = PAGE_SIZE - INTERNAL_NODE_HEADER_SIZE - CATALOG_SIZE;
+static const uint32_t INTERNAL_NODE_MAX_CELLS = INTERNAL_NODE_SPACE_FOR_CELLS / INTERNAL_NODE_CELL_SIZE;
 
 uint32_t* leaf_node_num_cells(void* node);
 
+uint32_t* leaf_node_value_size(void* node);
+
+uint32_t leaf_node_cell_size(void* node);
+
+uint32_t leaf_node_max_cells(void* node);
+
 void* leaf_node_cell(void* node, uint32_t cell_num);
 
 uint32_t* leaf_node_next_leaf(void* node);
 
-uint32_t* leaf_node_key(void* node, uint32_t cell_num);
+Key* leaf_node_key(void* node, uint32_t cell_num);
+
+uint32_t* leaf_node_txn(void* node, uint32_t cell_num);
 
 void* leaf_node_value(void* node, uint32_t cell_num);
 
@@ -78,7 +123,19 @@ uint32_t* internal_node_cell(void* node, uint32_t cell_num);
 
 uint32_t* internal_node_child(void* node, uint32_t child_num);
 
-uint32_t* internal_node_key(void* node, uint32_t key_num);
+Key* internal_node_key(void* node, uint32_t key_num);
+
+uint32_t* internal_node_right_count(void* node);
+
+uint32_t* internal_node_child_count(void* node, uint32_t child_num);
+
+Key* internal_node_low_fence(void* node);
+
+Key* internal_node_high_fence(void* node);
+
+uint32_t node_row_count(void* node);
+
+void refresh_internal_cells(Table* table);
 
 bool is_node_root(void* node);
 
@@ -88,26 +145,30 @@ NodeType get_node_type(void* node);
 
 void set_node_type(void* node, NodeType type);
 
-uint32_t get_node_max_key(Pager* pager, void* node);
+Key get_node_max_key(void* node);
 
-uint32_t* node_parent(void* node);
+Key get_node_min_key(void* node);
 
-uint32_t internal_node_find_child(void* node, uint32_t key);
+uint32_t* node_txn(void* node);
 
-void internal_node_split_and_insert(Table* table, uint32_t parent_page_num, uint32_t child_page_num);
+uint32_t internal_node_find_child(void* node, const Key* key);
 
-void internal_node_insert(Table* table, uint32_t parent_page_num, uint32_t child_page_num);
+void internal_node_split_and_insert(Table* table, const uint32_t* path, uint32_t level, uint32_t child_page_num);
 
-void update_internal_node_key(void* node, uint32_t old_key, uint32_t new_key);
+void internal_node_insert(Table* table, const uint32_t* path, uint32_t level, uint32_t child_page_num);
 
-void initialize_leaf_node(void* node);
+void update_internal_node_key(void* node, const Key* old_key, const Key* new_key);
+
+void initialize_leaf_node(void* node, uint32_t value_size);
 
 void initialize_internal_node(void* node);
 
 void create_new_root(Table* table, uint32_t right_child_page_num);
 
-void leaf_node_split_and_insert(Cursor* cursor, uint32_t key, Row* value);
+void leaf_node_split_and_insert(Cursor* cursor, const Key* key, Row* value);
+
+void leaf_node_insert(Cursor* cursor, const Key* key, Row* value);
 
-void leaf_node_insert(Cursor* cursor, uint32_t key, Row* value);
+void leaf_node_delete(Cursor* cursor);
 
 #endif // NODE_H
\ No newline at end of file
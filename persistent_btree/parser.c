@@ -0,0 +1,369 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <ctype.h>
+
+#include "table.h"
+#include "parser.h"
+
+static bool is_word_char(char c) {
+	return c != '\0' && !isspace((unsigned char)c) && strchr(",()*=<>?'", c) == NULL;
+}
+
+static void lex_word(Lexer* lexer, Token* token) {
+	const char* start = lexer->position;
+	while (is_word_char(*lexer->position)) {
+		lexer->position++;
+	}
+	token->type = TOKEN_WORD;
+	token->text = start;
+	token->length = lexer->position - start;
+
+	const char* digits = (*start == '-') ? start + 1 : start;
+	if (digits == lexer->position) {
+		return;
+	}
+
+	uint64_t number = 0;
+	bool overflow = false;
+	for (const char* c = digits; c < lexer->position; c++) {
+		if (!isdigit((unsigned char)*c)) {
+			return;
+		}
+		uint64_t digit = *c - '0';
+		if (number > (UINT64_MAX - digit) / 10) {
+			overflow = true;
+		} else {
+			number = number * 10 + digit;
+		}
+	}
+	token->type = TOKEN_NUMBER;
+	token->number = number;
+	token->negative = (*start == '-');
+	token->overflow = overflow;
+}
+
+void lexer_init(Lexer* lexer, const char* text) {
+	lexer->position = text;
+	lexer_next(lexer);
+}
+
+Token* lexer_next(Lexer* lexer) {
+	Token* token = &lexer->current;
+	while (isspace((unsigned char)*lexer->position)) {
+		lexer->position++;
+	}
+
+	token->text = lexer->position;
+	token->length = 1;
+	token->number = 0;
+	token->negative = false;
+	token->overflow = false;
+
+	char c = *lexer->position;
+	switch (c) {
+		case ('\0'):
+			token->type = TOKEN_END;
+			token->length = 0;
+			return token;
+		case (','):
+			token->type = TOKEN_COMMA;
+			break;
+		case ('('):
+			token->type = TOKEN_LEFT_PAREN;
+			break;
+		case (')'):
+			token->type = TOKEN_RIGHT_PAREN;
+			break;
+		case ('*'):
+			token->type = TOKEN_STAR;
+			break;
+		case ('?'):
+			token->type = TOKEN_PARAM;
+			break;
+		case ('='):
+			token->type = TOKEN_EQUAL;
+			break;
+		case ('<'):
+		case ('>'):
+			if (lexer->position[1] == '=') {
+				token->type = (c == '<') ? TOKEN_LESS_EQUAL : TOKEN_GREATER_EQUAL;
+				token->length = 2;
+			} else {
+				token->type = (c == '<') ? TOKEN_LESS : TOKEN_GREATER;
+			}
+			break;
+		case ('\''): {
+			const char* end = strchr(lexer->position + 1, '\'');
+			if (end == NULL) {
+				token->type = TOKEN_INVALID;
+				return token;
+			}
+			token->type = TOKEN_STRING;
+			token->text = lexer->position + 1;
+			token->length = end - token->text;
+			lexer->position = end + 1;
+			return token;
+		}
+		default:
+			lex_word(lexer, token);
+			return token;
+	}
+
+	lexer->position += token->length;
+	return token;
+}
+
+static bool is_keyword(Token* token, const char* keyword) {
+	if (token->type != TOKEN_WORD || token->length != strlen(keyword)) {
+		return false;
+	}
+	for (uint32_t i = 0; i < token->length; i++) {
+		if (tolower((unsigned char)token->text[i]) != keyword[i]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool accept_keyword(Lexer* lexer, const char* keyword) {
+	if (!is_keyword(&lexer->current, keyword)) {
+		return false;
+	}
+	lexer_next(lexer);
+	return true;
+}
+
+static bool accept(Lexer* lexer, TokenType type) {
+	if (lexer->current.type != type) {
+		return false;
+	}
+	lexer_next(lexer);
+	return true;
+}
+
+static bool parse_column(Lexer* lexer, Column* column) {
+	if (accept_keyword(lexer, "id")) {
+		*column = COLUMN_ID;
+	} else if (accept_keyword(lexer, "username")) {
+		*column = COLUMN_USERNAME;
+	} else if (accept_keyword(lexer, "email")) {
+		*column = COLUMN_EMAIL;
+	} else {
+		return false;
+	}
+	return true;
+}
+
+static bool parse_value(Lexer* lexer, AstValue* value) {
+	Token* token = &lexer->current;
+	switch (token->type) {
+		case (TOKEN_NUMBER):
+			value->type = VALUE_NUMBER;
+			break;
+		case (TOKEN_WORD):
+		case (TOKEN_STRING):
+			value->type = VALUE_TEXT;
+			break;
+		case (TOKEN_PARAM):
+			value->type = VALUE_PARAM;
+			break;
+		default:
+			return false;
+	}
+
+	value->number = token->number;
+	value->negative = token->negative;
+	value->overflow = token->overflow;
+	value->text = token->text;
+	value->length = token->length;
+	lexer_next(lexer);
+	return true;
+}
+
+static PrepareResult parse_insert(Lexer* lexer, AstStatement* ast) {
+	ast->type = AST_INSERT;
+
+	for (uint32_t i = 0; i < AST_NUM_INSERT_VALUES; i++) {
+		if (i > 0) {
+			accept(lexer, TOKEN_COMMA);
+		}
+		if (!parse_value(lexer, &ast->values[i])) {
+			return PREPARE_SYNTAX_ERROR;
+		}
+	}
+
+	return PREPARE_SUCCESS;
+}
+
+static PrepareResult parse_projection(Lexer* lexer, AstStatement* ast) {
+	ast->columns = ALL_COLUMNS;
+	ast->aggregate = AGGREGATE_NONE;
+
+	if (accept(lexer, TOKEN_STAR)) {
+		return PREPARE_SUCCESS;
+	}
+
+	if (accept_keyword(lexer, "count")) {
+		ast->aggregate = AGGREGATE_COUNT;
+	} else if (accept_keyword(lexer, "min")) {
+		ast->aggregate = AGGREGATE_MIN;
+	} else if (accept_keyword(lexer, "max")) {
+		ast->aggregate = AGGREGATE_MAX;
+	} else if (accept_keyword(lexer, "sum")) {
+		ast->aggregate = AGGREGATE_SUM;
+	}
+
+	if (ast->aggregate != AGGREGATE_NONE) {
+		if (!accept(lexer, TOKEN_LEFT_PAREN)) {
+			return PREPARE_SYNTAX_ERROR;
+		}
+		bool argument_ok = (ast->aggregate == AGGREGATE_COUNT)
+			? accept(lexer, TOKEN_STAR)
+			: accept_keyword(lexer, "id");
+		if (!argument_ok || !accept(lexer, TOKEN_RIGHT_PAREN)) {
+			return PREPARE_SYNTAX_ERROR;
+		}
+		return PREPARE_SUCCESS;
+	}
+
+	Column column;
+	if (!parse_column(lexer, &column)) {
+		/* A bare select projects every column. */
+		return PREPARE_SUCCESS;
+	}
+	ast->columns = 1 << column;
+	while (accept(lexer, TOKEN_COMMA)) {
+		if (!parse_column(lexer, &column)) {
+			return PREPARE_SYNTAX_ERROR;
+		}
+		ast->columns |= 1 << column;
+	}
+
+	return PREPARE_SUCCESS;
+}
+
+static PrepareResult add_predicate(AstStatement* ast, Column column, CompareOp op, AstValue* value) {
+	if (ast->num_predicates == AST_MAX_PREDICATES) {
+		return PREPARE_SYNTAX_ERROR;
+	}
+
+	AstPredicate* predicate = &ast->predicates[ast->num_predicates++];
+	predicate->column = column;
+	predicate->op = op;
+	predicate->value = *value;
+	return PREPARE_SUCCESS;
+}
+
+static PrepareResult parse_predicate(Lexer* lexer, AstStatement* ast) {
+	Column column;
+	if (!parse_column(lexer, &column)) {
+		return PREPARE_SYNTAX_ERROR;
+	}
+
+	AstValue value;
+	if (accept_keyword(lexer, "between")) {
+		AstValue upper;
+		if (!parse_value(lexer, &value) || !accept_keyword(lexer, "and") || !parse_value(lexer, &upper)) {
+			return PREPARE_SYNTAX_ERROR;
+		}
+		PrepareResult result = add_predicate(ast, column, COMPARE_GREATER_EQUAL, &value);
+		if (result != PREPARE_SUCCESS) {
+			return result;
+		}
+		return add_predicate(ast, column, COMPARE_LESS_EQUAL, &upper);
+	}
+
+	CompareOp op;
+	switch (lexer->current.type) {
+		case (TOKEN_EQUAL):
+			op = COMPARE_EQUAL;
+			break;
+		case (TOKEN_LESS):
+			op = COMPARE_LESS;
+			break;
+		case (TOKEN_LESS_EQUAL):
+			op = COMPARE_LESS_EQUAL;
+			break;
+		case (TOKEN_GREATER):
+			op = COMPARE_GREATER;
+			break;
+		case (TOKEN_GREATER_EQUAL):
+			op = COMPARE_GREATER_EQUAL;
+			break;
+		default:
+			return PREPARE_SYNTAX_ERROR;
+	}
+	lexer_next(lexer);
+
+	if (!parse_value(lexer, &value)) {
+		return PREPARE_SYNTAX_ERROR;
+	}
+	return add_predicate(ast, column, op, &value);
+}
+
+static PrepareResult parse_select(Lexer* lexer, AstStatement* ast) {
+	ast->type = AST_SELECT;
+
+	PrepareResult result = parse_projection(lexer, ast);
+	if (result != PREPARE_SUCCESS) {
+		return result;
+	}
+
+	if (accept_keyword(lexer, "from")) {
+		if (lexer->current.type != TOKEN_WORD) {
+			return PREPARE_SYNTAX_ERROR;
+		}
+		ast->table_name = lexer->current.text;
+		ast->table_name_length = lexer->current.length;
+		lexer_next(lexer);
+	}
+
+	if (accept_keyword(lexer, "where")) {
+		do {
+			result = parse_predicate(lexer, ast);
+			if (result != PREPARE_SUCCESS) {
+				return result;
+			}
+		} while (accept_keyword(lexer, "and"));
+	}
+
+	return PREPARE_SUCCESS;
+}
+
+static PrepareResult parse_create_index(Lexer* lexer, AstStatement* ast) {
+	ast->type = AST_CREATE_INDEX;
+
+	if (!accept_keyword(lexer, "index") || !accept_keyword(lexer, "on")
+			|| !parse_column(lexer, &ast->index_column)) {
+		return PREPARE_SYNTAX_ERROR;
+	}
+	return PREPARE_SUCCESS;
+}
+
+/* Fills ast from text. Value and name tokens point into text. */
+PrepareResult parse_statement(const char* text, AstStatement* ast) {
+	memset(ast, 0, sizeof(AstStatement));
+
+	Lexer lexer;
+	lexer_init(&lexer, text);
+
+	PrepareResult result;
+	if (accept_keyword(&lexer, "insert")) {
+		result = parse_insert(&lexer, ast);
+	} else if (accept_keyword(&lexer, "create")) {
+		result = parse_create_index(&lexer, ast);
+	} else {
+		ast->explain = accept_keyword(&lexer, "explain");
+		if (!accept_keyword(&lexer, "select")) {
+			return ast->explain ? PREPARE_SYNTAX_ERROR : PREPARE_UNRECOGNIZED_COMMAND;
+		}
+		result = parse_select(&lexer, ast);
+	}
+
+	if (result == PREPARE_SUCCESS && lexer.current.type != TOKEN_END) {
+		return PREPARE_SYNTAX_ERROR;
+	}
+	return result;
+}
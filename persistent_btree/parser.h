@@ -0,0 +1,134 @@
+#ifndef PARSER_H
+#define PARSER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "table.h"
+
+#define AST_MAX_PREDICATES 4
+#define AST_NUM_INSERT_VALUES 3
+
+typedef enum {
+	PREPARE_SUCCESS,
+	PREPARE_NEGATIVE_ID,
+	PREPARE_UNRECOGNIZED_COMMAND,
+	PREPARE_STRING_TOO_LONG,
+	PREPARE_SYNTAX_ERROR,
+	PREPARE_UNKNOWN_TABLE
+} PrepareResult;
+
+typedef enum {
+	TOKEN_END,
+	TOKEN_INVALID,
+	TOKEN_WORD,
+	TOKEN_NUMBER,
+	TOKEN_STRING,
+	TOKEN_PARAM,
+	TOKEN_COMMA,
+	TOKEN_LEFT_PAREN,
+	TOKEN_RIGHT_PAREN,
+	TOKEN_STAR,
+	TOKEN_EQUAL,
+	TOKEN_LESS,
+	TOKEN_LESS_EQUAL,
+	TOKEN_GREATER,
+	TOKEN_GREATER_EQUAL
+} TokenType;
+
+/*
+ * Words are runs of anything that is not whitespace, punctuation or a quote,
+ * so bare emails lex as one token. A word that is all digits, with an
+ * optional leading '-', is a number. A number keeps its magnitude and sign
+ * apart, and overflow is set if the magnitude does not fit in 64 bits. Text
+ * points into the source.
+*/
+typedef struct {
+	TokenType type;
+	const char* text;
+	uint32_t length;
+	uint64_t number;
+	bool negative;
+	bool overflow;
+} Token;
+
+typedef struct {
+	const char* position;
+	Token current;
+} Lexer;
+
+typedef enum {
+	AGGREGATE_NONE,
+	AGGREGATE_COUNT,
+	AGGREGATE_MIN,
+	AGGREGATE_MAX,
+	AGGREGATE_SUM
+} AggregateType;
+
+typedef enum {
+	COMPARE_EQUAL,
+	COMPARE_LESS,
+	COMPARE_LESS_EQUAL,
+	COMPARE_GREATER,
+	COMPARE_GREATER_EQUAL
+} CompareOp;
+
+typedef enum {
+	VALUE_NUMBER,
+	VALUE_TEXT,
+	VALUE_PARAM
+} ValueType;
+
+/* A literal or `?`. Number tokens keep their text so they can fill strings. */
+typedef struct {
+	ValueType type;
+	uint64_t number;
+	bool negative;
+	bool overflow;
+	const char* text;
+	uint32_t length;
+} AstValue;
+
+typedef struct {
+	Column column;
+	CompareOp op;
+	AstValue value;
+} AstPredicate;
+
+typedef enum {
+	AST_INSERT,
+	AST_SELECT,
+	AST_CREATE_INDEX
+} AstType;
+
+/*
+ * insert := INSERT value [,] value [,] value
+ * select := [EXPLAIN] SELECT [projection] [FROM word]
+ *           [WHERE predicate {AND predicate}]
+ * projection := * | column {, column} | COUNT(*) | MIN(id) | MAX(id) | SUM(id)
+ * predicate := column op value | column BETWEEN value AND value
+ * create_index := CREATE INDEX ON column
+ *
+ * BETWEEN is stored as a >= and a <= predicate. Keywords and column names
+ * are case-insensitive.
+*/
+typedef struct {
+	AstType type;
+	bool explain;
+	AstValue values[AST_NUM_INSERT_VALUES];
+	Column index_column;
+	uint32_t columns;
+	AggregateType aggregate;
+	const char* table_name;
+	uint32_t table_name_length;
+	uint32_t num_predicates;
+	AstPredicate predicates[AST_MAX_PREDICATES];
+} AstStatement;
+
+void lexer_init(Lexer* lexer, const char* text);
+
+Token* lexer_next(Lexer* lexer);
+
+PrepareResult parse_statement(const char* text, AstStatement* ast);
+
+#endif // PARSER_H
@@ -0,0 +1,129 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "table.h"
+#include "node.h"
+#include "scan.h"
+
+typedef struct {
+	Table* table;
+	uint32_t first_leaf;
+	uint32_t stop_leaf;
+	uint32_t snapshot_txn;
+	ScanRowFn fn;
+	void* context;
+} ScanPartition;
+
+static uint32_t leftmost_leaf(Pager* pager, uint32_t page_num) {
+	void* node = get_page(pager, page_num);
+	while (get_node_type(node) == NODE_INTERNAL) {
+		page_num = *internal_node_child(node, 0);
+		node = get_page(pager, page_num);
+	}
+	return page_num;
+}
+
+/*
+ * Splits the leaf chain into at most max_partitions contiguous runs by
+ * descending the internal levels until there are enough subtrees, then
+ * grouping neighbouring subtrees. first_leaves receives the first leaf of
+ * each run in key order; a run ends where the next one starts.
+*/
+uint32_t table_partition(Table* table, uint32_t max_partitions, uint32_t* first_leaves) {
+	uint32_t level[TABLE_MAX_PAGES];
+	uint32_t next_level[TABLE_MAX_PAGES];
+	uint32_t level_size = 1;
+	level[0] = table->root_page_num;
+
+	while (level_size < max_partitions) {
+		void* first = get_page(table->pager, level[0]);
+		if (get_node_type(first) != NODE_INTERNAL) {
+			break;
+		}
+
+		uint32_t next_size = 0;
+		for (uint32_t i = 0; i < level_size; i++) {
+			void* node = get_page(table->pager, level[i]);
+			uint32_t num_keys = *internal_node_num_keys(node);
+			for (uint32_t child = 0; child <= num_keys; child++) {
+				next_level[next_size++] = *internal_node_child(node, child);
+			}
+		}
+
+		memcpy(level, next_level, next_size * sizeof(uint32_t));
+		level_size = next_size;
+	}
+
+	uint32_t num_partitions = level_size < max_partitions ? level_size : max_partitions;
+	for (uint32_t i = 0; i < num_partitions; i++) {
+		uint32_t first_subtree = (uint64_t)i * level_size / num_partitions;
+		first_leaves[i] = leftmost_leaf(table->pager, level[first_subtree]);
+	}
+
+	return num_partitions;
+}
+
+static void* scan_partition(void* arg) {
+	ScanPartition* partition = arg;
+	Pager* pager = partition->table->pager;
+	uint32_t page_num = partition->first_leaf;
+
+	while (true) {
+		void* node = get_page(pager, page_num);
+		uint32_t num_cells = *leaf_node_num_cells(node);
+		for (uint32_t i = 0; i < num_cells; i++) {
+			if (*leaf_node_txn(node, i) <= partition->snapshot_txn) {
+				partition->fn(leaf_node_value(node, i), partition->context);
+			}
+		}
+
+		page_num = *leaf_node_next_leaf(node);
+		if (page_num == 0 || page_num == partition->stop_leaf) {
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Runs fn over every row visible at the current snapshot using up to
+ * num_workers threads. Worker i sees a contiguous key range and is handed
+ * contexts[i]; ranges are ordered, so concatenating per-worker output gives
+ * key order. Returns the number of workers actually used.
+*/
+uint32_t table_parallel_scan(Table* table, uint32_t num_workers, ScanRowFn fn, void** contexts) {
+	if (num_workers > SCAN_MAX_WORKERS) {
+		num_workers = SCAN_MAX_WORKERS;
+	}
+
+	uint32_t first_leaves[SCAN_MAX_WORKERS];
+	uint32_t num_partitions = table_partition(table, num_workers, first_leaves);
+
+	ScanPartition partitions[SCAN_MAX_WORKERS];
+	pthread_t threads[SCAN_MAX_WORKERS];
+	for (uint32_t i = 0; i < num_partitions; i++) {
+		partitions[i].table = table;
+		partitions[i].first_leaf = first_leaves[i];
+		partitions[i].stop_leaf = i + 1 < num_partitions ? first_leaves[i + 1] : 0;
+		partitions[i].snapshot_txn = table->txn;
+		partitions[i].fn = fn;
+		partitions[i].context = contexts[i];
+	}
+
+	for (uint32_t i = 1; i < num_partitions; i++) {
+		if (pthread_create(&threads[i], NULL, scan_partition, &partitions[i]) != 0) {
+			printf("Error creating scan worker\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+	scan_partition(&partitions[0]);
+	for (uint32_t i = 1; i < num_partitions; i++) {
+		pthread_join(threads[i], NULL);
+	}
+
+	return num_partitions;
+}
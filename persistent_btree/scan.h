@@ -0,0 +1,16 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stdint.h>
+
+#include "table.h"
+
+#define SCAN_MAX_WORKERS 64
+
+typedef void (*ScanRowFn)(void* value, void* context);
+
+uint32_t table_partition(Table* table, uint32_t max_partitions, uint32_t* first_leaves);
+
+uint32_t table_parallel_scan(Table* table, uint32_t num_workers, ScanRowFn fn, void** contexts);
+
+#endif // SCAN_H
@@ -0,0 +1,194 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "table.h"
+#include "sink.h"
+
+/*
+ * Worst case for one row: CSV quoting can double both strings, plus the id,
+ * separators and line ending.
+*/
+static const size_t SINK_MAX_ROW_SIZE = 2 * (COLUMN_USERNAME_SIZE + COLUMN_EMAIL_SIZE) + 32;
+
+ResultSink* sink_open(SinkFormat format, FILE* stream) {
+	ResultSink* sink = malloc(sizeof(ResultSink));
+	sink->format = format;
+	sink->stream = stream;
+	sink->length = 0;
+	sink->capacity = SINK_BUFFER_SIZE;
+	sink->data = malloc(sink->capacity);
+
+	return sink;
+}
+
+void sink_flush(ResultSink* sink) {
+	if (sink->stream == NULL || sink->length == 0) {
+		return;
+	}
+
+	fwrite(sink->data, 1, sink->length, sink->stream);
+	sink->length = 0;
+}
+
+static void sink_reserve(ResultSink* sink, size_t needed) {
+	if (sink->length + needed <= sink->capacity) {
+		return;
+	}
+
+	if (sink->stream != NULL) {
+		sink_flush(sink);
+		if (needed <= sink->capacity) {
+			return;
+		}
+	}
+
+	while (sink->length + needed > sink->capacity) {
+		sink->capacity *= 2;
+	}
+	sink->data = realloc(sink->data, sink->capacity);
+}
+
+void sink_write_raw(ResultSink* sink, const char* data, size_t length) {
+	sink_reserve(sink, length);
+	memcpy(sink->data + sink->length, data, length);
+	sink->length += length;
+}
+
+static char* format_uint64(char* out, uint64_t value) {
+	char digits[20];
+	uint32_t num_digits = 0;
+
+	do {
+		digits[num_digits++] = '0' + value % 10;
+		value /= 10;
+	} while (value != 0);
+
+	while (num_digits > 0) {
+		*out++ = digits[--num_digits];
+	}
+	return out;
+}
+
+static char* format_csv_field(char* out, const char* field, size_t length) {
+	bool needs_quotes = false;
+	for (size_t i = 0; i < length; i++) {
+		if (field[i] == ',' || field[i] == '"' || field[i] == '\n' || field[i] == '\r') {
+			needs_quotes = true;
+			break;
+		}
+	}
+
+	if (!needs_quotes) {
+		memcpy(out, field, length);
+		return out + length;
+	}
+
+	*out++ = '"';
+	for (size_t i = 0; i < length; i++) {
+		if (field[i] == '"') {
+			*out++ = '"';
+		}
+		*out++ = field[i];
+	}
+	*out++ = '"';
+	return out;
+}
+
+/*
+ * Formats straight from the serialized row in the leaf, so only the bytes
+ * of each string up to its terminator are touched. columns is a mask of
+ * (1 << Column); the selected columns are written in table order.
+*/
+void sink_write_columns(ResultSink* sink, void* value, uint32_t columns) {
+	uint64_t id;
+	memcpy(&id, value + ID_OFFSET, ID_SIZE);
+	const char* strings[] = {NULL, value + USERNAME_OFFSET, value + EMAIL_OFFSET};
+	size_t lengths[] = {
+		0,
+		strnlen(strings[COLUMN_USERNAME], COLUMN_USERNAME_SIZE),
+		strnlen(strings[COLUMN_EMAIL], COLUMN_EMAIL_SIZE)
+	};
+
+	sink_reserve(sink, SINK_MAX_ROW_SIZE);
+	char* out = sink->data + sink->length;
+
+	char* record_start = out;
+	if (sink->format == SINK_TEXT) {
+		*out++ = '(';
+	} else if (sink->format == SINK_BINARY) {
+		out += sizeof(uint32_t);
+	}
+
+	bool first = true;
+	for (uint32_t column = COLUMN_ID; column <= COLUMN_EMAIL; column++) {
+		if (!(columns & (1 << column))) {
+			continue;
+		}
+
+		switch (sink->format) {
+			case (SINK_TEXT):
+				if (!first) {
+					*out++ = ',';
+					*out++ = ' ';
+				}
+				if (column == COLUMN_ID) {
+					out = format_uint64(out, id);
+				} else {
+					memcpy(out, strings[column], lengths[column]);
+					out += lengths[column];
+				}
+				break;
+			case (SINK_CSV):
+				if (!first) {
+					*out++ = ',';
+				}
+				if (column == COLUMN_ID) {
+					out = format_uint64(out, id);
+				} else {
+					out = format_csv_field(out, strings[column], lengths[column]);
+				}
+				break;
+			case (SINK_BINARY):
+				if (column == COLUMN_ID) {
+					memcpy(out, &id, ID_SIZE);
+					out += ID_SIZE;
+				} else {
+					*out++ = (uint8_t)lengths[column];
+					memcpy(out, strings[column], lengths[column]);
+					out += lengths[column];
+				}
+				break;
+		}
+		first = false;
+	}
+
+	switch (sink->format) {
+		case (SINK_TEXT):
+			*out++ = ')';
+			*out++ = '\n';
+			break;
+		case (SINK_CSV):
+			*out++ = '\n';
+			break;
+		case (SINK_BINARY): {
+			uint32_t record_length = out - record_start - sizeof(uint32_t);
+			memcpy(record_start, &record_length, sizeof(record_length));
+			break;
+		}
+	}
+
+	sink->length = out - sink->data;
+}
+
+void sink_write_row(ResultSink* sink, void* value) {
+	sink_write_columns(sink, value, ALL_COLUMNS);
+}
+
+void sink_close(ResultSink* sink) {
+	sink_flush(sink);
+	free(sink->data);
+	free(sink);
+}
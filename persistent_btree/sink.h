@@ -0,0 +1,48 @@
+#ifndef SINK_H
+#define SINK_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "table.h"
+
+#define SINK_BUFFER_SIZE 65536
+
+/*
+ * A binary record is a uint32_t length of the rest of the record, then the
+ * selected columns in table order: the id as a native-endian uint64_t, each
+ * string as a one-byte length and its bytes. Ids were a uint32_t before keys
+ * grew to 64 bits, so readers of older output must be updated.
+*/
+typedef enum {
+	SINK_TEXT,
+	SINK_CSV,
+	SINK_BINARY
+} SinkFormat;
+
+/*
+ * Accumulates formatted rows in one large buffer and hands it to stream a
+ * buffer at a time. A sink without a stream grows instead of flushing, which
+ * lets scan workers format privately and be drained in order afterwards.
+*/
+typedef struct {
+	SinkFormat format;
+	FILE* stream;
+	char* data;
+	size_t length;
+	size_t capacity;
+} ResultSink;
+
+ResultSink* sink_open(SinkFormat format, FILE* stream);
+
+void sink_write_row(ResultSink* sink, void* value);
+
+void sink_write_columns(ResultSink* sink, void* value, uint32_t columns);
+
+void sink_write_raw(ResultSink* sink, const char* data, size_t length);
+
+void sink_flush(ResultSink* sink);
+
+void sink_close(ResultSink* sink);
+
+#endif // SINK_H
@@ -0,0 +1,638 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "table.h"
+#include "node.h"
+#include "scan.h"
+#include "sink.h"
+#include "parser.h"
+#include "vector.h"
+#include "index.h"
+#include "statement.h"
+#include "stats.h"
+#include "cache.h"
+#include "bloom.h"
+
+static PrepareResult add_param(Statement* statement, ParamTarget target, uint32_t predicate) {
+	if (statement->num_params == STATEMENT_MAX_PARAMS) {
+		return PREPARE_SYNTAX_ERROR;
+	}
+
+	statement->unbound |= 1u << statement->num_params;
+	statement->params[statement->num_params].target = target;
+	statement->params[statement->num_params].predicate = predicate;
+	statement->num_params++;
+	return PREPARE_SUCCESS;
+}
+
+static PrepareResult plan_id(AstValue* value, uint64_t* id) {
+	if (value->type != VALUE_NUMBER) {
+		return PREPARE_SYNTAX_ERROR;
+	}
+	if (value->negative && (value->number > 0 || value->overflow)) {
+		return PREPARE_NEGATIVE_ID;
+	}
+	if (value->overflow) {
+		return PREPARE_SYNTAX_ERROR;
+	}
+
+	*id = value->number;
+	return PREPARE_SUCCESS;
+}
+
+static PrepareResult plan_text(AstValue* value, char* destination, uint32_t max_length) {
+	if (value->length > max_length) {
+		return PREPARE_STRING_TOO_LONG;
+	}
+
+	memcpy(destination, value->text, value->length);
+	destination[value->length] = '\0';
+	return PREPARE_SUCCESS;
+}
+
+static uint32_t column_size(Column column) {
+	return column == COLUMN_USERNAME ? COLUMN_USERNAME_SIZE : COLUMN_EMAIL_SIZE;
+}
+
+static PrepareResult plan_insert(AstStatement* ast, Statement* statement) {
+	statement->type = STATEMENT_INSERT;
+
+	Row* row = &statement->row_to_insert;
+	char* strings[] = {NULL, row->username, row->email};
+	ParamTarget targets[] = {PARAM_ID, PARAM_USERNAME, PARAM_EMAIL};
+
+	for (uint32_t i = 0; i < AST_NUM_INSERT_VALUES; i++) {
+		AstValue* value = &ast->values[i];
+		PrepareResult result;
+		if (value->type == VALUE_PARAM) {
+			result = add_param(statement, targets[i], 0);
+		} else if (i == COLUMN_ID) {
+			result = plan_id(value, &row->id);
+		} else {
+			result = plan_text(value, strings[i], column_size(i));
+		}
+		if (result != PREPARE_SUCCESS) {
+			return result;
+		}
+	}
+
+	return PREPARE_SUCCESS;
+}
+
+static PrepareResult plan_select(AstStatement* ast, Statement* statement) {
+	statement->type = STATEMENT_SELECT;
+	statement->explain = ast->explain;
+	statement->columns = ast->columns;
+	statement->aggregate = ast->aggregate;
+
+	if (ast->table_name != NULL
+			&& (ast->table_name_length != 5 || strncmp(ast->table_name, "users", 5) != 0)) {
+		return PREPARE_UNKNOWN_TABLE;
+	}
+
+	statement->access = ACCESS_SCAN;
+	statement->num_predicates = ast->num_predicates;
+	for (uint32_t i = 0; i < ast->num_predicates; i++) {
+		AstPredicate* source = &ast->predicates[i];
+		Predicate* predicate = &statement->predicates[i];
+		predicate->column = source->column;
+		predicate->op = source->op;
+
+		PrepareResult result;
+		if (source->value.type == VALUE_PARAM) {
+			result = add_param(statement, PARAM_PREDICATE, i);
+		} else if (source->column == COLUMN_ID) {
+			result = plan_id(&source->value, &predicate->number);
+		} else {
+			result = plan_text(&source->value, predicate->text, column_size(source->column));
+		}
+		if (result != PREPARE_SUCCESS) {
+			return result;
+		}
+
+		if (source->column != COLUMN_ID) {
+			continue;
+		}
+		if (source->op == COMPARE_EQUAL) {
+			statement->access = ACCESS_SEEK;
+		} else if (statement->access == ACCESS_SCAN) {
+			statement->access = ACCESS_RANGE;
+		}
+	}
+
+	if (statement->access == ACCESS_SEEK) {
+		return PREPARE_SUCCESS;
+	}
+	for (uint32_t i = 0; i < statement->num_predicates; i++) {
+		Predicate* predicate = &statement->predicates[i];
+		if (predicate->column != COLUMN_ID && predicate->op == COMPARE_EQUAL) {
+			statement->access = ACCESS_INDEX;
+			statement->index_column = predicate->column;
+			statement->index_predicate = i;
+			break;
+		}
+	}
+
+	return PREPARE_SUCCESS;
+}
+
+static PrepareResult plan_create_index(AstStatement* ast, Statement* statement) {
+	statement->type = STATEMENT_CREATE_INDEX;
+	statement->index_column = ast->index_column;
+
+	/* id is the table's own key. */
+	return ast->index_column == COLUMN_ID ? PREPARE_SYNTAX_ERROR : PREPARE_SUCCESS;
+}
+
+PrepareResult plan_statement(AstStatement* ast, Statement* statement) {
+	memset(statement, 0, sizeof(Statement));
+
+	switch (ast->type) {
+		case (AST_INSERT):
+			return plan_insert(ast, statement);
+		case (AST_SELECT):
+			return plan_select(ast, statement);
+		case (AST_CREATE_INDEX):
+			return plan_create_index(ast, statement);
+	}
+
+	return PREPARE_UNRECOGNIZED_COMMAND;
+}
+
+PrepareResult prepare_statement(const char* text, Statement* statement) {
+	AstStatement ast;
+	PrepareResult result = parse_statement(text, &ast);
+	if (result != PREPARE_SUCCESS) {
+		return result;
+	}
+
+	return plan_statement(&ast, statement);
+}
+
+static bool param_is_id(Statement* statement, Param* param) {
+	return param->target == PARAM_ID
+		|| (param->target == PARAM_PREDICATE
+			&& statement->predicates[param->predicate].column == COLUMN_ID);
+}
+
+PrepareResult statement_bind_int(Statement* statement, uint32_t index, uint64_t value) {
+	if (index >= statement->num_params || !param_is_id(statement, &statement->params[index])) {
+		return PREPARE_SYNTAX_ERROR;
+	}
+
+	Param* param = &statement->params[index];
+	if (param->target == PARAM_ID) {
+		statement->row_to_insert.id = value;
+	} else {
+		statement->predicates[param->predicate].number = value;
+	}
+
+	statement->unbound &= ~(1u << index);
+	return PREPARE_SUCCESS;
+}
+
+PrepareResult statement_bind_text(Statement* statement, uint32_t index, const char* value) {
+	if (index >= statement->num_params) {
+		return PREPARE_SYNTAX_ERROR;
+	}
+
+	Param* param = &statement->params[index];
+	AstValue parsed;
+	Lexer lexer;
+	lexer_init(&lexer, value);
+	parsed.type = (lexer.current.type == TOKEN_NUMBER) ? VALUE_NUMBER : VALUE_TEXT;
+	parsed.number = lexer.current.number;
+	parsed.negative = lexer.current.negative;
+	parsed.overflow = lexer.current.overflow;
+	parsed.text = value;
+	parsed.length = strlen(value);
+
+	PrepareResult result;
+	if (param_is_id(statement, param)) {
+		uint64_t id;
+		result = plan_id(&parsed, &id);
+		return result == PREPARE_SUCCESS ? statement_bind_int(statement, index, id) : result;
+	}
+
+	switch (param->target) {
+		case (PARAM_USERNAME):
+			result = plan_text(&parsed, statement->row_to_insert.username, COLUMN_USERNAME_SIZE);
+			break;
+		case (PARAM_EMAIL):
+			result = plan_text(&parsed, statement->row_to_insert.email, COLUMN_EMAIL_SIZE);
+			break;
+		default: {
+			Predicate* predicate = &statement->predicates[param->predicate];
+			result = plan_text(&parsed, predicate->text, column_size(predicate->column));
+			break;
+		}
+	}
+	if (result != PREPARE_SUCCESS) {
+		return result;
+	}
+
+	statement->unbound &= ~(1u << index);
+	return PREPARE_SUCCESS;
+}
+
+static ExecuteResult execute_insert(Statement* statement, Table* table) {
+	if (indexed_put(table, &statement->row_to_insert, false) == PUT_DUPLICATE) {
+		return EXECUTE_DUPLICATE_KEY;
+	}
+	return EXECUTE_SUCCESS;
+}
+
+/* Intersects the id predicates. Returns false if no key can satisfy them. */
+static bool id_bounds(Statement* statement, uint64_t* low, uint64_t* high) {
+	*low = 0;
+	*high = UINT64_MAX;
+
+	for (uint32_t i = 0; i < statement->num_predicates; i++) {
+		Predicate* predicate = &statement->predicates[i];
+		if (predicate->column != COLUMN_ID) {
+			continue;
+		}
+
+		uint64_t value = predicate->number;
+		switch (predicate->op) {
+			case (COMPARE_EQUAL):
+				*low = value > *low ? value : *low;
+				*high = value < *high ? value : *high;
+				break;
+			case (COMPARE_LESS):
+				if (value == 0) {
+					return false;
+				}
+				*high = value - 1 < *high ? value - 1 : *high;
+				break;
+			case (COMPARE_LESS_EQUAL):
+				*high = value < *high ? value : *high;
+				break;
+			case (COMPARE_GREATER):
+				if (value == UINT64_MAX) {
+					return false;
+				}
+				*low = value + 1 > *low ? value + 1 : *low;
+				break;
+			case (COMPARE_GREATER_EQUAL):
+				*low = value > *low ? value : *low;
+				break;
+		}
+	}
+
+	return *low <= *high;
+}
+
+static bool has_filter(Statement* statement) {
+	for (uint32_t i = 0; i < statement->num_predicates; i++) {
+		if (statement->predicates[i].column != COLUMN_ID) {
+			return true;
+		}
+	}
+	return false;
+}
+
+typedef struct {
+	ResultSink* sink;
+	uint32_t columns;
+} ProjectionContext;
+
+static void sink_row(void* value, void* context) {
+	ProjectionContext* projection = context;
+	sink_write_columns(projection->sink, value, projection->columns);
+}
+
+static ExecuteResult execute_parallel_select(Statement* statement, Table* table, ResultSink* output, uint32_t num_threads) {
+	ProjectionContext projections[SCAN_MAX_WORKERS];
+	void* contexts[SCAN_MAX_WORKERS];
+	for (uint32_t i = 0; i < num_threads; i++) {
+		projections[i].sink = sink_open(output->format, NULL);
+		projections[i].columns = statement->columns;
+		contexts[i] = &projections[i];
+	}
+
+	uint32_t num_workers = table_parallel_scan(table, num_threads, sink_row, contexts);
+
+	for (uint32_t i = 0; i < num_workers; i++) {
+		sink_write_raw(output, projections[i].sink->data, projections[i].sink->length);
+	}
+	for (uint32_t i = 0; i < num_threads; i++) {
+		sink_close(projections[i].sink);
+	}
+
+	return EXECUTE_SUCCESS;
+}
+
+static void add_id(void* value, void* context) {
+	uint64_t id;
+	memcpy(&id, value + ID_OFFSET, ID_SIZE);
+	*(uint64_t*)context += id;
+}
+
+static uint64_t parallel_sum(Table* table, uint32_t num_threads) {
+	uint64_t sums[SCAN_MAX_WORKERS];
+	void* contexts[SCAN_MAX_WORKERS];
+	for (uint32_t i = 0; i < num_threads; i++) {
+		sums[i] = 0;
+		contexts[i] = &sums[i];
+	}
+
+	uint32_t num_workers = table_parallel_scan(table, num_threads, add_id, contexts);
+	uint64_t sum = 0;
+	for (uint32_t i = 0; i < num_workers; i++) {
+		sum += sums[i];
+	}
+	return sum;
+}
+
+static void write_result(ResultSink* output, bool present, unsigned long long value) {
+	char line[32];
+	int length = present
+		? snprintf(line, sizeof(line), "(%llu)\n", value)
+		: snprintf(line, sizeof(line), "(NULL)\n");
+	sink_write_raw(output, line, length);
+}
+
+/*
+ * Answers an unfiltered aggregate from the subtree counts or the tree's
+ * edges where it can. Returns false if the rows have to be visited.
+*/
+static bool execute_aggregate_shortcut(Statement* statement, Table* table, ResultSink* output,
+		uint32_t num_threads, uint64_t low, uint64_t high) {
+	Key key, high_key;
+	bool found;
+
+	switch (statement->aggregate) {
+		case (AGGREGATE_COUNT):
+			key_from_uint64(&key, low);
+			key_from_uint64(&high_key, high);
+			write_result(output, true, statement->access == ACCESS_SCAN
+				? table_count(table)
+				: table_count_range(table, &key, &high_key));
+			return true;
+		case (AGGREGATE_MIN):
+		case (AGGREGATE_MAX):
+			if (statement->access != ACCESS_SCAN) {
+				return false;
+			}
+			found = (statement->aggregate == AGGREGATE_MIN)
+				? table_min_key(table, &key)
+				: table_max_key(table, &key);
+			write_result(output, found, found ? key_to_uint64(&key) : 0);
+			return true;
+		case (AGGREGATE_SUM):
+			if (statement->access != ACCESS_SCAN) {
+				return false;
+			}
+			write_result(output, true, parallel_sum(table, num_threads));
+			return true;
+		case (AGGREGATE_NONE):
+			return false;
+	}
+
+	return false;
+}
+
+static AccessPath resolve_access(Statement* statement, Table* table) {
+	if (statement->access != ACCESS_INDEX || index_exists(table, statement->index_column)) {
+		return statement->access;
+	}
+
+	for (uint32_t i = 0; i < statement->num_predicates; i++) {
+		if (statement->predicates[i].column == COLUMN_ID) {
+			return ACCESS_RANGE;
+		}
+	}
+	return ACCESS_SCAN;
+}
+
+/*
+ * With a row cache attached, an unfiltered `id =` select is answered from
+ * the cache, or on a miss by one descent whose row is then cached.
+*/
+static void execute_cached_seek(Statement* statement, Table* table, ResultSink* output, uint64_t id) {
+	uint8_t value[ROW_SIZE];
+	if (!row_cache_get(table->row_cache, id, value)) {
+		Key key;
+		key_from_uint64(&key, id);
+		Cursor* cursor = table_find(table, &key);
+		bool found = cursor_at_key(cursor, &key);
+		if (found) {
+			void* node = get_page(table->pager, cursor->page_num);
+			memcpy(value, leaf_node_value(node, cursor->cell_num), ROW_SIZE);
+			row_cache_put(table->row_cache, id, value);
+		}
+		free(cursor);
+
+		if (!found) {
+			return;
+		}
+	}
+
+	sink_write_columns(output, value, statement->columns);
+}
+
+static ExecuteResult execute_select(Statement* statement, Table* table, ResultSink* output, uint32_t num_threads) {
+	AccessPath access = resolve_access(statement, table);
+	uint64_t low, high;
+	bool empty = !id_bounds(statement, &low, &high);
+	if (!empty && access == ACCESS_SEEK && !bloom_may_contain(table, low)) {
+		empty = true;
+	}
+	bool filtered = has_filter(statement);
+
+	if (statement->aggregate == AGGREGATE_NONE) {
+		if (empty) {
+			return EXECUTE_SUCCESS;
+		}
+		if (access == ACCESS_SEEK && !filtered && table->row_cache != NULL) {
+			execute_cached_seek(statement, table, output, low);
+			return EXECUTE_SUCCESS;
+		}
+		if (access == ACCESS_SCAN && !filtered && num_threads > 1) {
+			return execute_parallel_select(statement, table, output, num_threads);
+		}
+	} else if (!filtered && !empty
+			&& execute_aggregate_shortcut(statement, table, output, num_threads, low, high)) {
+		return EXECUTE_SUCCESS;
+	}
+
+	uint32_t count = 0;
+	uint64_t sum = 0;
+	uint64_t min = 0, max = 0, id;
+
+	/* scan -> filter -> project or aggregate, a batch of leaves at a time */
+	VectorScan scan;
+	RowBatch* batch = malloc(sizeof(RowBatch));
+	if (access == ACCESS_INDEX) {
+		Predicate* predicate = &statement->predicates[statement->index_predicate];
+		vector_scan_open_index(&scan, table, predicate->column, predicate->text, low, high);
+	} else {
+		vector_scan_open(&scan, table, low, high);
+	}
+	while (!empty && vector_scan_next(&scan, batch)) {
+		for (uint32_t i = 0; i < statement->num_predicates; i++) {
+			Predicate* predicate = &statement->predicates[i];
+			if (predicate->column != COLUMN_ID) {
+				vector_filter_text(batch, predicate->column, predicate->op, predicate->text);
+			}
+		}
+
+		switch (statement->aggregate) {
+			case (AGGREGATE_NONE):
+				vector_project(batch, output, statement->columns);
+				break;
+			case (AGGREGATE_COUNT):
+				count += vector_count(batch);
+				break;
+			case (AGGREGATE_SUM):
+				sum += vector_sum(batch);
+				break;
+			case (AGGREGATE_MIN):
+				if (vector_first(batch, &id) && (count == 0 || id < min)) {
+					min = id;
+					count = 1;
+				}
+				break;
+			case (AGGREGATE_MAX):
+				if (vector_last(batch, &id) && (count == 0 || id > max)) {
+					max = id;
+					count = 1;
+				}
+				break;
+		}
+	}
+	vector_scan_close(&scan);
+	free(batch);
+
+	switch (statement->aggregate) {
+		case (AGGREGATE_COUNT):
+			write_result(output, true, count);
+			break;
+		case (AGGREGATE_MIN):
+			write_result(output, count > 0, min);
+			break;
+		case (AGGREGATE_MAX):
+			write_result(output, count > 0, max);
+			break;
+		case (AGGREGATE_SUM):
+			write_result(output, true, sum);
+			break;
+		case (AGGREGATE_NONE):
+			break;
+	}
+
+	return EXECUTE_SUCCESS;
+}
+
+static void explain_select(Statement* statement, Table* table, ResultSink* output) {
+	static const char* column_names[] = {"id", "username", "email"};
+	static const char* aggregate_names[] = {"", "count", "min", "max", "sum"};
+
+	char line[128];
+	int length = 0;
+	switch (resolve_access(statement, table)) {
+		case (ACCESS_SCAN):
+			length = snprintf(line, sizeof(line), "scan users\n");
+			break;
+		case (ACCESS_RANGE):
+			length = snprintf(line, sizeof(line), "range scan users by id\n");
+			break;
+		case (ACCESS_SEEK):
+			length = snprintf(line, sizeof(line), "seek users by id\n");
+			break;
+		case (ACCESS_INDEX):
+			length = snprintf(line, sizeof(line), "lookup users by index on %s\n", column_names[statement->index_column]);
+			break;
+	}
+	sink_write_raw(output, line, length);
+
+	for (uint32_t i = 0; i < statement->num_predicates; i++) {
+		Column column = statement->predicates[i].column;
+		if (column != COLUMN_ID) {
+			length = snprintf(line, sizeof(line), "filter %s\n", column_names[column]);
+			sink_write_raw(output, line, length);
+		}
+	}
+
+	if (statement->aggregate != AGGREGATE_NONE) {
+		length = snprintf(line, sizeof(line), "aggregate %s\n", aggregate_names[statement->aggregate]);
+		sink_write_raw(output, line, length);
+	}
+}
+
+/* Results go to output; the caller flushes or closes it. */
+ExecuteResult execute_statement(Statement* statement, Table* table, ResultSink* output, uint32_t num_threads) {
+	if (statement->explain) {
+		explain_select(statement, table, output);
+		return EXECUTE_SUCCESS;
+	}
+	if (statement->unbound != 0) {
+		return EXECUTE_UNBOUND_PARAMETER;
+	}
+
+	uint64_t start = stats_now_ns();
+	ExecuteResult result;
+	StatHistogram latency;
+	switch (statement->type) {
+		case (STATEMENT_INSERT):
+			result = execute_insert(statement, table);
+			latency = STAT_INSERT_LATENCY;
+			break;
+		case (STATEMENT_SELECT):
+			result = execute_select(statement, table, output, num_threads);
+			latency = STAT_SELECT_LATENCY;
+			break;
+		case (STATEMENT_CREATE_INDEX):
+			result = index_create(table, statement->index_column) ? EXECUTE_SUCCESS : EXECUTE_INDEX_EXISTS;
+			latency = STAT_CREATE_INDEX_LATENCY;
+			break;
+		default:
+			printf("Unknown statement type %d\n", statement->type);
+			exit(EXIT_FAILURE);
+	}
+
+	stats_record(latency, stats_now_ns() - start);
+	return result;
+}
+
+StatementCache* statement_cache_new() {
+	return calloc(1, sizeof(StatementCache));
+}
+
+/*
+ * Copies the plan for text into statement, parsing only on a miss. Plans
+ * that fail to parse are not cached.
+*/
+PrepareResult statement_cache_prepare(StatementCache* cache, const char* text, Statement* statement) {
+	uint32_t hash = hash_bytes(text, strlen(text));
+	StatementCacheEntry* entry = &cache->entries[hash % STATEMENT_CACHE_SLOTS];
+
+	if (entry->text != NULL && entry->hash == hash && strcmp(entry->text, text) == 0) {
+		cache->hits++;
+		*statement = entry->statement;
+		return PREPARE_SUCCESS;
+	}
+
+	cache->misses++;
+	PrepareResult result = prepare_statement(text, statement);
+	if (result != PREPARE_SUCCESS) {
+		return result;
+	}
+
+	free(entry->text);
+	entry->hash = hash;
+	entry->text = strdup(text);
+	entry->statement = *statement;
+	return PREPARE_SUCCESS;
+}
+
+void statement_cache_free(StatementCache* cache) {
+	for (uint32_t i = 0; i < STATEMENT_CACHE_SLOTS; i++) {
+		free(cache->entries[i].text);
+	}
+	free(cache);
+}
@@ -0,0 +1,119 @@
+#ifndef STATEMENT_H
+#define STATEMENT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "table.h"
+#include "sink.h"
+#include "parser.h"
+
+#define STATEMENT_MAX_PARAMS 4
+#define STATEMENT_CACHE_SLOTS 256
+
+typedef enum {
+	STATEMENT_INSERT,
+	STATEMENT_SELECT,
+	STATEMENT_CREATE_INDEX
+} StatementType;
+
+/*
+ * How a select reaches its rows. Predicates on id never become filters: the
+ * planner turns them into [low, high] bounds on the key, so a seek or range
+ * scan starts at table_find(low) and stops past high. An equality on an
+ * indexed string column reads just that string's index entries; plans are
+ * made without the table, so if the index is missing at execution the
+ * select falls back to a range scan or scan.
+*/
+typedef enum {
+	ACCESS_SCAN,
+	ACCESS_RANGE,
+	ACCESS_SEEK,
+	ACCESS_INDEX
+} AccessPath;
+
+typedef enum {
+	EXECUTE_SUCCESS,
+	EXECUTE_TABLE_FULL,
+	EXECUTE_DUPLICATE_KEY,
+	EXECUTE_UNBOUND_PARAMETER,
+	EXECUTE_INDEX_EXISTS
+} ExecuteResult;
+
+/* Where a bound value lands in the plan. */
+typedef enum {
+	PARAM_ID,
+	PARAM_USERNAME,
+	PARAM_EMAIL,
+	PARAM_PREDICATE
+} ParamTarget;
+
+typedef struct {
+	ParamTarget target;
+	uint32_t predicate;
+} Param;
+
+/* A where-clause term with its value converted to the column's type. */
+typedef struct {
+	Column column;
+	CompareOp op;
+	uint64_t number;
+	char text[COLUMN_EMAIL_SIZE + 1];
+} Predicate;
+
+/*
+ * A planned statement. `?` placeholders are recorded in params in the order
+ * they appear; unbound has bit i set until parameter i is bound, and a
+ * statement only executes once it is zero. Literal values are stored in the
+ * same fields the parameters bind into, so a plan is a plain value that can
+ * be copied and re-bound freely.
+*/
+typedef struct {
+	StatementType type;
+	bool explain;
+	Row row_to_insert;
+	uint32_t columns;
+	AggregateType aggregate;
+	AccessPath access;
+	Column index_column;
+	uint32_t index_predicate;
+	uint32_t num_predicates;
+	Predicate predicates[AST_MAX_PREDICATES];
+	uint32_t num_params;
+	Param params[STATEMENT_MAX_PARAMS];
+	uint32_t unbound;
+} Statement;
+
+typedef struct {
+	uint32_t hash;
+	char* text;
+	Statement statement;
+} StatementCacheEntry;
+
+/*
+ * Direct-mapped cache of planned statements keyed by the hash of their
+ * text. A colliding statement replaces the slot's previous occupant.
+*/
+typedef struct {
+	StatementCacheEntry entries[STATEMENT_CACHE_SLOTS];
+	uint32_t hits;
+	uint32_t misses;
+} StatementCache;
+
+PrepareResult plan_statement(AstStatement* ast, Statement* statement);
+
+PrepareResult prepare_statement(const char* text, Statement* statement);
+
+PrepareResult statement_bind_int(Statement* statement, uint32_t index, uint64_t value);
+
+PrepareResult statement_bind_text(Statement* statement, uint32_t index, const char* value);
+
+ExecuteResult execute_statement(Statement* statement, Table* table, ResultSink* output, uint32_t num_threads);
+
+StatementCache* statement_cache_new();
+
+PrepareResult statement_cache_prepare(StatementCache* cache, const char* text, Statement* statement);
+
+void statement_cache_free(StatementCache* cache);
+
+#endif // STATEMENT_H
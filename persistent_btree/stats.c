@@ -0,0 +1,147 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "stats.h"
+
+typedef struct StatsBlock {
+	Stats stats;
+	struct StatsBlock* next;
+} StatsBlock;
+
+static _Thread_local StatsBlock* thread_block = NULL;
+static StatsBlock* live_blocks = NULL;
+static Stats retired;
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t stats_key;
+static pthread_once_t stats_key_once = PTHREAD_ONCE_INIT;
+
+static const char* counter_names[] = {
+	"page_hits", "page_misses", "page_reads", "page_writes", "leaf_splits", "internal_splits",
+	"row_cache_hits", "row_cache_misses", "bloom_negatives", "memtable_flushes", "compactions"
+};
+
+static const char* histogram_names[] = {
+	"insert_latency", "select_latency", "create_index_latency"
+};
+
+/*
+ * source may be another thread's live block, so its values are loaded
+ * atomically; destination is only ever touched under stats_lock.
+*/
+static void stats_merge(Stats* destination, const Stats* source) {
+	for (uint32_t i = 0; i < STAT_NUM_COUNTERS; i++) {
+		destination->counters[i] += __atomic_load_n(&source->counters[i], __ATOMIC_RELAXED);
+	}
+	for (uint32_t h = 0; h < STAT_NUM_HISTOGRAMS; h++) {
+		for (uint32_t b = 0; b < STATS_HISTOGRAM_BUCKETS; b++) {
+			destination->histograms[h][b] += __atomic_load_n(&source->histograms[h][b], __ATOMIC_RELAXED);
+		}
+	}
+}
+
+/* Runs as a thread exits: folds its block into the retired totals. */
+static void stats_retire(void* value) {
+	StatsBlock* block = value;
+
+	pthread_mutex_lock(&stats_lock);
+	stats_merge(&retired, &block->stats);
+	for (StatsBlock** link = &live_blocks; *link != NULL; link = &(*link)->next) {
+		if (*link == block) {
+			*link = block->next;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&stats_lock);
+
+	free(block);
+}
+
+static void stats_create_key() {
+	pthread_key_create(&stats_key, stats_retire);
+}
+
+static StatsBlock* stats_register() {
+	pthread_once(&stats_key_once, stats_create_key);
+
+	StatsBlock* block = calloc(1, sizeof(StatsBlock));
+	pthread_mutex_lock(&stats_lock);
+	block->next = live_blocks;
+	live_blocks = block;
+	pthread_mutex_unlock(&stats_lock);
+
+	pthread_setspecific(stats_key, block);
+	thread_block = block;
+	return block;
+}
+
+static Stats* local_stats() {
+	StatsBlock* block = thread_block;
+	if (block == NULL) {
+		block = stats_register();
+	}
+	return &block->stats;
+}
+
+void stats_add(StatCounter counter, uint64_t amount) {
+	__atomic_fetch_add(&local_stats()->counters[counter], amount, __ATOMIC_RELAXED);
+}
+
+void stats_record(StatHistogram histogram, uint64_t nanoseconds) {
+	uint32_t bucket = 0;
+	while (bucket + 1 < STATS_HISTOGRAM_BUCKETS && (nanoseconds >> (bucket + 1)) != 0) {
+		bucket++;
+	}
+	__atomic_fetch_add(&local_stats()->histograms[histogram][bucket], 1, __ATOMIC_RELAXED);
+}
+
+uint64_t stats_now_ns() {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+void stats_read(Stats* stats) {
+	pthread_mutex_lock(&stats_lock);
+	memcpy(stats, &retired, sizeof(Stats));
+	for (StatsBlock* block = live_blocks; block != NULL; block = block->next) {
+		stats_merge(stats, &block->stats);
+	}
+	pthread_mutex_unlock(&stats_lock);
+}
+
+uint64_t stats_histogram_count(const uint64_t* buckets) {
+	uint64_t count = 0;
+	for (uint32_t b = 0; b < STATS_HISTOGRAM_BUCKETS; b++) {
+		count += buckets[b];
+	}
+	return count;
+}
+
+/* Upper bound of the bucket holding the sample at fraction of the way up, or 0 if empty. */
+uint64_t stats_histogram_percentile(const uint64_t* buckets, double fraction) {
+	uint64_t count = stats_histogram_count(buckets);
+	if (count == 0) {
+		return 0;
+	}
+
+	uint64_t rank = (uint64_t)(fraction * (count - 1));
+	uint64_t seen = 0;
+	for (uint32_t b = 0; b < STATS_HISTOGRAM_BUCKETS; b++) {
+		seen += buckets[b];
+		if (seen > rank) {
+			return b + 1 < STATS_HISTOGRAM_BUCKETS ? (1ull << (b + 1)) - 1 : UINT64_MAX;
+		}
+	}
+	return UINT64_MAX;
+}
+
+const char* stats_counter_name(StatCounter counter) {
+	return counter_names[counter];
+}
+
+const char* stats_histogram_name(StatHistogram histogram) {
+	return histogram_names[histogram];
+}
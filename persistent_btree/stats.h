@@ -0,0 +1,58 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+
+#define STATS_HISTOGRAM_BUCKETS 64
+
+/*
+ * Engine counters and latency histograms. Each thread updates a block of
+ * its own with relaxed atomics and without locking; stats_read sums the
+ * live blocks and the totals left by threads that have exited. A read taken
+ * while other threads are running may lag their latest updates.
+*/
+typedef enum {
+	STAT_PAGE_HITS,
+	STAT_PAGE_MISSES,
+	STAT_PAGE_READS,
+	STAT_PAGE_WRITES,
+	STAT_LEAF_SPLITS,
+	STAT_INTERNAL_SPLITS,
+	STAT_ROW_CACHE_HITS,
+	STAT_ROW_CACHE_MISSES,
+	STAT_BLOOM_NEGATIVES,
+	STAT_MEMTABLE_FLUSHES,
+	STAT_COMPACTIONS,
+	STAT_NUM_COUNTERS
+} StatCounter;
+
+typedef enum {
+	STAT_INSERT_LATENCY,
+	STAT_SELECT_LATENCY,
+	STAT_CREATE_INDEX_LATENCY,
+	STAT_NUM_HISTOGRAMS
+} StatHistogram;
+
+/* Histogram bucket i counts samples in [2^i, 2^(i+1)) nanoseconds. */
+typedef struct {
+	uint64_t counters[STAT_NUM_COUNTERS];
+	uint64_t histograms[STAT_NUM_HISTOGRAMS][STATS_HISTOGRAM_BUCKETS];
+} Stats;
+
+void stats_add(StatCounter counter, uint64_t amount);
+
+void stats_record(StatHistogram histogram, uint64_t nanoseconds);
+
+uint64_t stats_now_ns();
+
+void stats_read(Stats* stats);
+
+uint64_t stats_histogram_count(const uint64_t* buckets);
+
+uint64_t stats_histogram_percentile(const uint64_t* buckets, double fraction);
+
+const char* stats_counter_name(StatCounter counter);
+
+const char* stats_histogram_name(StatHistogram histogram);
+
+#endif // STATS_H
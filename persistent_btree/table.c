@@ -10,6 +10,12 @@
 
 #include "table.h"
 #include "node.h"
+#include "cow.h"
+#include "compress.h"
+#include "stats.h"
+#include "cache.h"
+#include "hash.h"
+#include "version.h"
 
 void serialize_row(Row* source, void* destination) {
 	memcpy(destination + ID_OFFSET, &(source->id), ID_SIZE);
@@ -23,9 +29,19 @@ void deserialize_row(void* source, Row* destination) {
 	memcpy(&(destination->email), source + EMAIL_OFFSET, EMAIL_SIZE);
 }
 
+/* FNV-1a. */
+uint32_t hash_bytes(const void* bytes, uint32_t length) {
+	const uint8_t* byte = bytes;
+	uint32_t hash = 2166136261u;
+	for (uint32_t i = 0; i < length; i++) {
+		hash = (hash ^ byte[i]) * 16777619u;
+	}
+	return hash;
+}
+
 uint32_t get_unused_page_num(Pager* pager) { return pager->num_pages; }
 
-Pager* pager_open(const char* filename) {
+Pager* pager_open(const char* filename, PagerMode mode) {
 	int fd = open(filename, O_RDWR | O_CREAT, S_IWUSR | S_IRUSR);
 
 	if (fd == -1) {
@@ -37,16 +53,37 @@ Pager* pager_open(const char* filename) {
 
 	Pager* pager = malloc(sizeof(Pager));
 	pager->file_descriptor = fd;
+	pager->filename = strdup(filename);
 	pager->file_length = file_length;
 	pager->num_pages = (file_length / PAGE_SIZE);
-
-	if (file_length % PAGE_SIZE != 0) {
-		printf("Db file is not a whole number of pages. Corrupt file.\n");
-		exit(EXIT_FAILURE);
-	}
+	pager->mode = mode;
+	pager->write_depth = 0;
+	pager->write_set_size = 0;
+	pthread_mutex_init(&pager->lock, NULL);
 
 	for (uint32_t i = 0; i < TABLE_MAX_PAGES; i++) {
 		pager->pages[i] = NULL;
+		pager->dirty[i] = false;
+	}
+
+	if (file_length == 0) {
+		if (mode == PAGER_COPY_ON_WRITE) {
+			cow_format(pager);
+		} else if (mode == PAGER_COMPRESSED) {
+			compressed_format(pager);
+		}
+	} else if (cow_is_cow_file(fd, file_length)) {
+		pager->mode = PAGER_COPY_ON_WRITE;
+		cow_open(pager);
+	} else if (compressed_is_compressed_file(fd, file_length)) {
+		pager->mode = PAGER_COMPRESSED;
+		compressed_open(pager);
+	} else {
+		pager->mode = PAGER_IN_PLACE;
+		if (file_length % PAGE_SIZE != 0) {
+			printf("Db file is not a whole number of pages. Corrupt file.\n");
+			exit(EXIT_FAILURE);
+		}
 	}
 
 	return pager;
@@ -71,29 +108,49 @@ void pager_flush(Pager* pager, uint32_t page_num) {
 		printf("Error writing: %d\n", errno);
 		exit(EXIT_FAILURE);
 	}
+	stats_add(STAT_PAGE_WRITES, 1);
 }
 
-void* get_page(Pager* pager, uint32_t page_num) {
-	if (page_num > TABLE_MAX_PAGES) {
+bool pager_in_write_set(Pager* pager, uint32_t page_num) {
+	for (uint32_t i = 0; i < pager->write_set_size; i++) {
+		if (pager->write_set[i] == page_num) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static void* fetch_page(Pager* pager, uint32_t page_num, bool track) {
+	if (page_num >= TABLE_MAX_PAGES) {
 		printf("Tried to fetch page number out of bounds. %d > %d\n", page_num, TABLE_MAX_PAGES);
 		exit(EXIT_FAILURE);
 	}
 
+	pthread_mutex_lock(&pager->lock);
+
 	if (pager->pages[page_num] == NULL) {
-		void* page = malloc(PAGE_SIZE);
+		stats_add(STAT_PAGE_MISSES, 1);
+		void* page = calloc(1, PAGE_SIZE);
 		uint32_t num_pages = pager->file_length / PAGE_SIZE;
 
 		if (pager->file_length % PAGE_SIZE) {
 			num_pages += 1;
 		}
 
-		if (page_num <= num_pages) {
+		if (pager->mode == PAGER_COPY_ON_WRITE) {
+			cow_read_page(pager, page_num, page);
+		} else if (pager->mode == PAGER_COMPRESSED) {
+			compressed_read_page(pager, page_num, page);
+		} else if (page_num <= num_pages) {
 			lseek(pager->file_descriptor, page_num * PAGE_SIZE, SEEK_SET);
 			ssize_t bytes_read = read(pager->file_descriptor, page, PAGE_SIZE);
 			if (bytes_read == -1) {
 				printf("Error reading file: %d\n", errno);
 				exit(EXIT_FAILURE);
 			}
+			if (bytes_read > 0) {
+				stats_add(STAT_PAGE_READS, 1);
+			}
 		}
 
 		pager->pages[page_num] = page;
@@ -102,35 +159,118 @@ void* get_page(Pager* pager, uint32_t page_num) {
 			pager->num_pages = page_num + 1;
 		}
 
+	} else {
+		stats_add(STAT_PAGE_HITS, 1);
+	}
+
+	if (track && pager->write_depth > 0) {
+		if (!pager_in_write_set(pager, page_num)) {
+			pager->write_set[pager->write_set_size++] = page_num;
+		}
+		pager->dirty[page_num] = true;
+	}
+
+	void* page = pager->pages[page_num];
+	pthread_mutex_unlock(&pager->lock);
+
+	return page;
+}
+
+void* get_page(Pager* pager, uint32_t page_num) {
+	return fetch_page(pager, page_num, true);
+}
+
+/*
+ * Fetches a page without adding it to the write set, for reading a node's
+ * header during a write without making the page part of the commit. The
+ * caller must not modify it.
+*/
+void* peek_page(Pager* pager, uint32_t page_num) {
+	return fetch_page(pager, page_num, false);
+}
+
+/*
+ * Every page fetched between pager_begin_write and pager_commit is treated as
+ * written. In copy-on-write mode the commit relocates those pages and swaps
+ * the meta page; in-place mode leaves them for db_close to flush. Writes
+ * nest, and only the outermost commit takes effect.
+*/
+void pager_begin_write(Pager* pager) {
+	if (pager->write_depth++ == 0) {
+		pager->write_set_size = 0;
+	}
+}
+
+void pager_commit(Pager* pager) {
+	if (--pager->write_depth > 0) {
+		return;
+	}
+	if (pager->mode == PAGER_COPY_ON_WRITE) {
+		cow_commit(pager);
 	}
+}
 
-	return pager->pages[page_num];
+/*
+ * One transaction id covers everything up to the outermost commit, so a
+ * batch of inserts becomes visible to snapshot cursors all at once.
+*/
+void table_begin_write(Table* table) {
+	if (table->pager->write_depth == 0) {
+		table->txn += 1;
+	}
+	pager_begin_write(table->pager);
+}
+
+void table_commit(Table* table) {
+	if (table->pager->write_depth == 1) {
+		*node_txn(get_page(table->pager, table->root_page_num)) = table->txn;
+	}
+	pager_commit(table->pager);
 }
 
 Table* db_open(const char* filename) {
-	Pager* pager = pager_open(filename);
+	return db_open_mode(filename, PAGER_IN_PLACE);
+}
+
+Table* db_open_mode(const char* filename, PagerMode mode) {
+	Pager* pager = pager_open(filename, mode);
 
 	Table* table = (Table*)malloc(sizeof(Table));
 	table->pager = pager;
 	table->root_page_num = 0;
+	table->row_cache = NULL;
+	table->versions = NULL;
 
 	if (pager->num_pages == 0) {
+		pager_begin_write(pager);
 		void* root_node = get_page(pager, 0);
-		initialize_leaf_node(root_node);
+		initialize_leaf_node(root_node, ROW_SIZE);
 		set_node_root(root_node, true);
+		pager_commit(pager);
+	} else if (hash_is_hash_page(get_page(pager, 0))) {
+		printf("File holds a hash table, not a B-tree.\n");
+		exit(EXIT_FAILURE);
 	}
 
+	table->txn = *node_txn(get_page(pager, table->root_page_num));
+	table->bloom_page_num = *(uint32_t*)(get_page(pager, 0) + CATALOG_BLOOM_OFFSET);
+
 	return table;
 }
 
 void db_close(Table* table) {
 	Pager* pager = table->pager;
 
+	if (pager->mode == PAGER_COMPRESSED) {
+		compressed_close(pager);
+	}
 	for (uint32_t i = 0; i < pager->num_pages; i++) {
 		if (pager->pages[i] == NULL) {
 			continue;
 		}
-		pager_flush(pager, i);
+		if (pager->mode == PAGER_IN_PLACE && pager->dirty[i]) {
+			pager_flush(pager, i);
+		}
 		free(pager->pages[i]);
 		pager->pages[i] = NULL;
 	}
@@ -147,28 +287,39 @@ void db_close(Table* table) {
 			pager->pages[i] = NULL;
 		}
 	}
+	pthread_mutex_destroy(&pager->lock);
+	free(pager->filename);
 	free(pager);
+	if (table->row_cache != NULL) {
+		row_cache_free(table->row_cache);
+	}
+	version_store_free(table->versions);
 	free(table);
 }
 
-Cursor* leaf_node_find(Table* table, uint32_t page_num, uint32_t key) {
+Cursor* leaf_node_find(Table* table, uint32_t page_num, const Key* key) {
 	void* node = get_page(table->pager, page_num);
 	uint32_t num_cells = *leaf_node_num_cells(node);
 
-	Cursor* cursor = malloc(sizeof(cursor));
+	Cursor* cursor = malloc(sizeof(Cursor));
 	cursor->table = table;
 	cursor->page_num = page_num;
+	cursor->depth = 0;
+	cursor->end_of_table = false;
+	cursor->snapshot_txn = table->txn;
+	cursor->page_txn = *node_txn(node);
+	cursor->key = *key;
 
 	uint32_t min_index = 0;
 	uint32_t one_past_max_index = num_cells;
 	while (one_past_max_index != min_index) {
 		uint32_t index = (min_index + one_past_max_index) / 2;
-		uint32_t key_at_index = *leaf_node_key(node, index);
-		if (key == key_at_index) {
+		int compared = key_compare(key, leaf_node_key(node, index));
+		if (compared == 0) {
 			cursor->cell_num = index;
 			return cursor;
 		}
-		if (key < key_at_index) {
+		if (compared < 0) {
 			one_past_max_index = index;
 		} else {
 			min_index = index + 1;
@@ -179,22 +330,30 @@ Cursor* leaf_node_find(Table* table, uint32_t page_num, uint32_t key) {
 	return cursor;
 }
 
-Cursor* internal_node_find(Table* table, uint32_t page_num, uint32_t key) {
+/* Descends from an internal node, recording each internal page passed in the cursor's path. */
+Cursor* internal_node_find(Table* table, uint32_t page_num, const Key* key) {
+	uint32_t path[TABLE_MAX_HEIGHT];
+	uint32_t depth = 0;
 	void* node = get_page(table->pager, page_num);
-	
-	uint32_t child_index = internal_node_find_child(node, key);
-	uint32_t child_num = *internal_node_child(node, child_index);
-	void* child = get_page(table->pager, child_num);
 
-	switch (get_node_type(child)) {
-		case NODE_LEAF:
-			return leaf_node_find(table, child_num, key);
-		case NODE_INTERNAL:
-			return internal_node_find(table, child_num, key);
+	while (get_node_type(node) == NODE_INTERNAL) {
+		if (depth == TABLE_MAX_HEIGHT) {
+			printf("Tree deeper than %d levels. Corrupt file.\n", TABLE_MAX_HEIGHT);
+			exit(EXIT_FAILURE);
+		}
+		path[depth++] = page_num;
+		uint32_t child_index = internal_node_find_child(node, key);
+		page_num = *internal_node_child(node, child_index);
+		node = get_page(table->pager, page_num);
 	}
+
+	Cursor* cursor = leaf_node_find(table, page_num, key);
+	memcpy(cursor->path, path, depth * sizeof(uint32_t));
+	cursor->depth = depth;
+	return cursor;
 }
 
-Cursor* table_find(Table* table, uint32_t key) {
+Cursor* table_find(Table* table, const Key* key) {
 	uint32_t root_page_num = table->root_page_num;
 	void* root_node = get_page(table->pager, root_page_num);
 
@@ -205,37 +364,165 @@ Cursor* table_find(Table* table, uint32_t key) {
 	}
 }
 
-Cursor* table_start(Table* table) {
+/* Whether a cursor from table_find landed on key rather than its insert position. */
+bool cursor_at_key(Cursor* cursor, const Key* key) {
+	void* node = get_page(cursor->table->pager, cursor->page_num);
+	return cursor->cell_num < *leaf_node_num_cells(node)
+		&& key_compare(leaf_node_key(node, cursor->cell_num), key) == 0;
+}
 
-	Cursor* cursor = table_find(table, 0);
+uint32_t table_count(Table* table) {
+	return node_row_count(get_page(table->pager, table->root_page_num));
+}
 
-	void* node = get_page(table->pager, cursor->page_num);
-	uint32_t num_cells = *leaf_node_num_cells(node);
-	cursor->end_of_table = (num_cells == 0);
+/*
+ * Rank of key: descends once, adding the stored row counts of every subtree
+ * entirely to the left of the search path. With inclusive set, keys equal
+ * to key are counted too.
+*/
+static uint32_t table_count_before(Table* table, const Key* key, bool inclusive) {
+	uint32_t count = 0;
+	void* node = get_page(table->pager, table->root_page_num);
+
+	while (get_node_type(node) == NODE_INTERNAL) {
+		uint32_t child_index = internal_node_find_child(node, key);
+		for (uint32_t i = 0; i < child_index; i++) {
+			count += *internal_node_child_count(node, i);
+		}
+		node = get_page(table->pager, *internal_node_child(node, child_index));
+	}
+
+	uint32_t min_index = 0;
+	uint32_t one_past_max_index = *leaf_node_num_cells(node);
+	while (one_past_max_index != min_index) {
+		uint32_t index = (min_index + one_past_max_index) / 2;
+		int compared = key_compare(leaf_node_key(node, index), key);
+		if (compared < 0 || (inclusive && compared == 0)) {
+			min_index = index + 1;
+		} else {
+			one_past_max_index = index;
+		}
+	}
+
+	return count + min_index;
+}
+
+uint32_t table_count_less_than(Table* table, const Key* key) {
+	return table_count_before(table, key, false);
+}
+
+uint32_t table_count_range(Table* table, const Key* start_key, const Key* end_key) {
+	if (key_compare(start_key, end_key) > 0) {
+		return 0;
+	}
+
+	return table_count_before(table, end_key, true) - table_count_before(table, start_key, false);
+}
+
+bool table_min_key(Table* table, Key* key) {
+	if (table_count(table) == 0) {
+		return false;
+	}
+
+	*key = get_node_min_key(get_page(table->pager, table->root_page_num));
+	return true;
+}
+
+/* Levels from the root to the leaves, counting both; every leaf is at the same depth. */
+uint32_t table_height(Table* table) {
+	uint32_t height = 1;
+	void* node = get_page(table->pager, table->root_page_num);
+	while (get_node_type(node) == NODE_INTERNAL) {
+		node = get_page(table->pager, *internal_node_child(node, 0));
+		height++;
+	}
+	return height;
+}
+
+bool table_max_key(Table* table, Key* key) {
+	if (table_count(table) == 0) {
+		return false;
+	}
+	*key = get_node_max_key(get_page(table->pager, table->root_page_num));
+	return true;
+}
+
+/*
+ * The row under cursor as its snapshot sees it: the cell, or the version
+ * the cell replaced if that is still kept. NULL if the row is too new.
+*/
+static void* cursor_visible_value(Cursor* cursor, void* node) {
+	if (*leaf_node_txn(node, cursor->cell_num) <= cursor->snapshot_txn) {
+		return leaf_node_value(node, cursor->cell_num);
+	}
+
+	uint64_t id = key_to_uint64(leaf_node_key(node, cursor->cell_num));
+	return version_find(cursor->table, id, cursor->snapshot_txn, NULL);
+}
+
+static void cursor_skip_invisible(Cursor* cursor) {
+	while (!cursor->end_of_table) {
+		void* node = get_page(cursor->table->pager, cursor->page_num);
+
+		if (cursor->cell_num >= *leaf_node_num_cells(node)) {
+			uint32_t next_page_num = *leaf_node_next_leaf(node);
+			if (next_page_num == 0) {
+				cursor->end_of_table = true;
+			} else {
+				cursor->page_num = next_page_num;
+				cursor->cell_num = 0;
+				cursor->page_txn = *node_txn(get_page(cursor->table->pager, next_page_num));
+			}
+			continue;
+		}
+
+		if (cursor_visible_value(cursor, node) != NULL) {
+			cursor->key = *leaf_node_key(node, cursor->cell_num);
+			return;
+		}
+		cursor->cell_num += 1;
+	}
+}
+
+static void cursor_revalidate(Cursor* cursor) {
+	void* node = get_page(cursor->table->pager, cursor->page_num);
+	if (*node_txn(node) == cursor->page_txn) {
+		return;
+	}
+
+	Cursor* fresh = table_find(cursor->table, &cursor->key);
+	cursor->page_num = fresh->page_num;
+	cursor->cell_num = fresh->cell_num;
+	cursor->page_txn = fresh->page_txn;
+	memcpy(cursor->path, fresh->path, fresh->depth * sizeof(uint32_t));
+	cursor->depth = fresh->depth;
+	free(fresh);
+}
+
+Cursor* table_seek(Table* table, const Key* key) {
+	Cursor* cursor = table_find(table, key);
+	cursor_skip_invisible(cursor);
 
 	return cursor;
 }
 
+Cursor* table_start(Table* table) {
+	Key first;
+	key_init(&first);
+	return table_seek(table, &first);
+}
+
 void* cursor_value(Cursor* cursor) {
-    uint32_t page_num = cursor->page_num;
+	cursor_revalidate(cursor);
 
-    void* page = get_page(cursor->table->pager, page_num);
+    void* page = get_page(cursor->table->pager, cursor->page_num);
     
-    return leaf_node_value(page, cursor->cell_num);
+    return cursor_visible_value(cursor, page);
 }
 
 void cursor_advance(Cursor* cursor) {
-    uint32_t page_num = cursor->page_num;
-	void* node = get_page(cursor->table->pager, page_num);
+	cursor_revalidate(cursor);
 
 	cursor->cell_num += 1;
-	if (cursor->cell_num >= (*leaf_node_num_cells(node))) {
-		uint32_t next_page_num = *leaf_node_next_leaf(node);
-		if (next_page_num == 0) {
-			cursor->end_of_table = true;
-		} else {
-			cursor->page_num = next_page_num;
-			cursor->cell_num = 0;
-		}
-	}
+	cursor_skip_invisible(cursor);
 }
\ No newline at end of file
@@ -3,11 +3,16 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#include <stdbool.h>
 
-#define TABLE_MAX_PAGES 100
+#include "key.h"
+
+#define TABLE_MAX_PAGES 1000
+#define TABLE_MAX_HEIGHT 16
 #define COLUMN_USERNAME_SIZE 32
 #define COLUMN_EMAIL_SIZE 255
 
@@ -15,29 +20,104 @@
 
 #define INVALID_PAGE_NUM UINT32_MAX
 
+typedef enum {
+	PAGER_IN_PLACE,
+	PAGER_COPY_ON_WRITE,
+	PAGER_COMPRESSED
+} PagerMode;
+
+/*
+ * In-memory copy of one copy-on-write meta page: the commit it describes and
+ * where each logical page of that commit lives in the file.
+*/
+typedef struct {
+	uint32_t txn;
+	uint32_t num_pages;
+	uint32_t page_map[TABLE_MAX_PAGES];
+} CowMeta;
+
+/*
+ * In-memory copy of a compressed file's page directory: where each logical
+ * page's image starts and how long it is. A length of PAGE_SIZE means the
+ * page is stored raw, 0 that it has no image.
+*/
+typedef struct {
+	uint32_t num_pages;
+	uint32_t offsets[TABLE_MAX_PAGES];
+	uint32_t lengths[TABLE_MAX_PAGES];
+} PageDirectory;
+
 typedef struct {
 	int file_descriptor;
+	char* filename;
 	uint32_t file_length;
 	uint32_t num_pages;
 	void* pages[TABLE_MAX_PAGES];
+	PagerMode mode;
+	uint32_t write_depth;
+	bool dirty[TABLE_MAX_PAGES];
+	uint32_t write_set[TABLE_MAX_PAGES];
+	uint32_t write_set_size;
+	uint32_t meta_slot;
+	CowMeta meta[2];
+	PageDirectory directory;
+	pthread_mutex_t lock;
 } Pager;
 
 typedef struct {
-	uint32_t id;
+	uint64_t id;
 	char username[COLUMN_USERNAME_SIZE + 1];
 	char email[COLUMN_EMAIL_SIZE + 1];
 } Row;
 
+/* Columns of Row, in order; projections are bit masks of (1 << Column). */
+typedef enum {
+	COLUMN_ID,
+	COLUMN_USERNAME,
+	COLUMN_EMAIL
+} Column;
+
+#define ALL_COLUMNS 0x7
+
+typedef struct RowCache RowCache;
+
+typedef struct VersionStore VersionStore;
+
+/*
+ * row_cache is NULL unless a row cache has been attached. bloom_page_num
+ * mirrors the catalog's Bloom filter header page, 0 if there is none, so a
+ * filter check does not have to read the root page. versions is NULL until
+ * a snapshot is first held (see version.h).
+*/
 typedef struct {
 	Pager* pager;
 	uint32_t root_page_num;
+	uint32_t txn;
+	RowCache* row_cache;
+	uint32_t bloom_page_num;
+	VersionStore* versions;
 } Table;
 
+/*
+ * A cursor reads the table as of snapshot_txn: rows stamped with a later
+ * transaction are skipped, unless the version store still keeps the version
+ * the snapshot saw, which is read instead. If the leaf it sits on has been
+ * rewritten since it was positioned (page_txn no longer matches), it
+ * re-seeks to key.
+ * path holds the internal pages from the root down to the leaf's parent, as
+ * seen by the descent that positioned it; an insert at the cursor climbs it
+ * to propagate splits. Nodes keep no parent pointers.
+*/
 typedef struct {
     Table* table;
     uint32_t page_num;
 	uint32_t cell_num;
     bool end_of_table;
+	uint32_t snapshot_txn;
+	uint32_t page_txn;
+	Key key;
+	uint32_t path[TABLE_MAX_HEIGHT];
+	uint32_t depth;
 } Cursor;
 
 static const uint32_t ID_SIZE = size_of_attribute(Row, id);
@@ -55,26 +135,58 @@ void serialize_row(Row* source, void* destination);
 
 void deserialize_row(void* source, Row* destination);
 
+uint32_t hash_bytes(const void* bytes, uint32_t length);
+
 uint32_t get_unused_page_num(Pager* pager);
 
-Pager* pager_open(const char* filename);
+Pager* pager_open(const char* filename, PagerMode mode);
 
 void pager_flush(Pager* pager, uint32_t page_num);
 
+void pager_begin_write(Pager* pager);
+
+void pager_commit(Pager* pager);
+
+void table_begin_write(Table* table);
+
+void table_commit(Table* table);
+
 void* get_page(Pager* pager, uint32_t page_num);
 
+void* peek_page(Pager* pager, uint32_t page_num);
+
+bool pager_in_write_set(Pager* pager, uint32_t page_num);
+
 Table* db_open(const char* filename);
 
+Table* db_open_mode(const char* filename, PagerMode mode);
+
 void db_close(Table* table);
 
-Cursor* leaf_node_find(Table* table, uint32_t page_num, uint32_t key);
+Cursor* leaf_node_find(Table* table, uint32_t page_num, const Key* key);
+
+Cursor* internal_node_find(Table* table, uint32_t page_num, const Key* key);
+
+Cursor* table_find(Table* table, const Key* key);
 
-Cursor* internal_node_find(Table* table, uint32_t page_num, uint32_t key);
+bool cursor_at_key(Cursor* cursor, const Key* key);
 
-Cursor* table_find(Table* table, uint32_t key);
+Cursor* table_seek(Table* table, const Key* key);
 
 Cursor* table_start(Table* table);
 
+uint32_t table_count(Table* table);
+
+uint32_t table_count_less_than(Table* table, const Key* key);
+
+uint32_t table_count_range(Table* table, const Key* start_key, const Key* end_key);
+
+bool table_min_key(Table* table, Key* key);
+
+bool table_max_key(Table* table, Key* key);
+
+uint32_t table_height(Table* table);
+
 void* cursor_value(Cursor* cursor);
 
 void cursor_advance(Cursor* cursor);
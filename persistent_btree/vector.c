@@ -0,0 +1,287 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "table.h"
+#include "node.h"
+#include "sink.h"
+#include "parser.h"
+#include "index.h"
+#include "vector.h"
+#include "version.h"
+
+void vector_scan_open(VectorScan* scan, Table* table, uint64_t low, uint64_t high) {
+	Key low_key;
+	key_from_uint64(&low_key, low);
+	Cursor* cursor = table_find(table, &low_key);
+	scan->table = table;
+	scan->page_num = cursor->page_num;
+	scan->done = false;
+	scan->snapshot_txn = version_hold_snapshot(table);
+	scan->low = low;
+	scan->high = high;
+	scan->by_index = false;
+	free(cursor);
+}
+
+void vector_scan_open_index(VectorScan* scan, Table* table, Column column, const char* text, uint64_t low, uint64_t high) {
+	index_tree(table, column, &scan->index);
+	index_key(text, &scan->index_key);
+	scan->index_column = column;
+	scan->index_text = text;
+
+	Cursor* cursor = table_find(&scan->index, &scan->index_key);
+	scan->table = table;
+	scan->page_num = cursor->page_num;
+	scan->cell_num = cursor->cell_num;
+	scan->page_txn = cursor->page_txn;
+	scan->last_key = scan->index_key;
+	scan->done = false;
+	scan->snapshot_txn = version_hold_snapshot(table);
+	scan->low = low;
+	scan->high = high;
+	scan->by_index = true;
+	free(cursor);
+}
+
+/* Kernel: a row survives if it is visible and its key is in bounds. */
+static void select_visible(RowBatch* batch, uint32_t snapshot_txn, uint64_t low, uint64_t high) {
+	uint32_t num_rows = batch->num_rows;
+	const uint64_t* ids = batch->ids;
+	const uint32_t* txns = batch->txns;
+	uint8_t* selected = batch->selected;
+
+	for (uint32_t i = 0; i < num_rows; i++) {
+		selected[i] = (txns[i] <= snapshot_txn) & (ids[i] >= low) & (ids[i] <= high);
+	}
+}
+
+/* Kernel: an in-bounds row too new for the snapshot is read as the version it saw, if one is kept. */
+static void select_versions(VectorScan* scan, RowBatch* batch) {
+	for (uint32_t i = 0; i < batch->num_rows; i++) {
+		if (batch->selected[i] || batch->txns[i] <= scan->snapshot_txn
+				|| batch->ids[i] < scan->low || batch->ids[i] > scan->high) {
+			continue;
+		}
+
+		void* value = version_find(scan->table, batch->ids[i], scan->snapshot_txn, &batch->txns[i]);
+		if (value != NULL) {
+			batch->values[i] = value;
+			batch->selected[i] = 1;
+		}
+	}
+}
+
+static void sort_by_id(RowBatch* batch) {
+	for (uint32_t i = 1; i < batch->num_rows; i++) {
+		uint64_t id = batch->ids[i];
+		uint32_t txn = batch->txns[i];
+		void* value = batch->values[i];
+		uint32_t j = i;
+		for (; j > 0 && batch->ids[j - 1] > id; j--) {
+			batch->ids[j] = batch->ids[j - 1];
+			batch->txns[j] = batch->txns[j - 1];
+			batch->values[j] = batch->values[j - 1];
+		}
+		batch->ids[j] = id;
+		batch->txns[j] = txn;
+		batch->values[j] = value;
+	}
+}
+
+static void index_scan_reseek(VectorScan* scan) {
+	Cursor* cursor = table_find(&scan->index, &scan->last_key);
+	scan->page_num = cursor->page_num;
+	scan->cell_num = cursor->cell_num + (cursor_at_key(cursor, &scan->last_key) ? 1 : 0);
+	scan->page_txn = cursor->page_txn;
+	free(cursor);
+}
+
+/*
+ * Follows the run of keys prefixed by the text's hash, looking each entry's
+ * row up in the table and keeping those whose column matches. Cells are
+ * read directly rather than through a snapshot cursor so entries too new
+ * to see still count toward the run; the row's own txn decides visibility,
+ * and a row too new for the snapshot is matched as the version it saw.
+*/
+static void index_scan_next(VectorScan* scan, RowBatch* batch) {
+	Pager* pager = scan->table->pager;
+	uint32_t offset = (scan->index_column == COLUMN_USERNAME) ? USERNAME_OFFSET : EMAIL_OFFSET;
+	uint32_t size = (scan->index_column == COLUMN_USERNAME) ? USERNAME_SIZE : EMAIL_SIZE;
+
+	while (!scan->done && batch->num_rows < VECTOR_BATCH_SIZE) {
+		void* node = get_page(pager, scan->page_num);
+		if (*node_txn(node) != scan->page_txn) {
+			index_scan_reseek(scan);
+			continue;
+		}
+		if (scan->cell_num >= *leaf_node_num_cells(node)) {
+			uint32_t next_page_num = *leaf_node_next_leaf(node);
+			if (next_page_num == 0) {
+				scan->done = true;
+			} else {
+				scan->page_num = next_page_num;
+				scan->cell_num = 0;
+				scan->page_txn = *node_txn(get_page(pager, next_page_num));
+			}
+			continue;
+		}
+
+		if (!key_has_prefix(leaf_node_key(node, scan->cell_num), &scan->index_key)) {
+			scan->done = true;
+			break;
+		}
+
+		scan->last_key = *leaf_node_key(node, scan->cell_num);
+		if (*leaf_node_txn(node, scan->cell_num) == LEAF_NODE_DELETED_TXN) {
+			scan->cell_num++;
+			continue;
+		}
+
+		Key key;
+		key_from_uint64(&key, index_entry_id(leaf_node_key(node, scan->cell_num)));
+		Cursor* cursor = table_find(scan->table, &key);
+		if (cursor_at_key(cursor, &key)) {
+			void* leaf = get_page(pager, cursor->page_num);
+			void* value = leaf_node_value(leaf, cursor->cell_num);
+			uint32_t txn = *leaf_node_txn(leaf, cursor->cell_num);
+			if (txn > scan->snapshot_txn) {
+				void* version = version_find(scan->table, key_to_uint64(&key), scan->snapshot_txn, &txn);
+				value = version != NULL ? version : value;
+			}
+			if (strncmp(value + offset, scan->index_text, size) == 0) {
+				uint32_t row = batch->num_rows++;
+				memcpy(&batch->ids[row], value + ID_OFFSET, ID_SIZE);
+				batch->txns[row] = txn;
+				batch->values[row] = value;
+			}
+		}
+		free(cursor);
+		scan->cell_num++;
+	}
+
+	sort_by_id(batch);
+}
+
+/*
+ * Fills batch with whole leaves until the next one would not fit. Returns
+ * false once the range is exhausted.
+*/
+bool vector_scan_next(VectorScan* scan, RowBatch* batch) {
+	Pager* pager = scan->table->pager;
+	batch->num_rows = 0;
+
+	if (scan->by_index) {
+		index_scan_next(scan, batch);
+		select_visible(batch, scan->snapshot_txn, scan->low, scan->high);
+		return batch->num_rows > 0;
+	}
+
+	while (!scan->done) {
+		void* node = get_page(pager, scan->page_num);
+		uint32_t num_cells = *leaf_node_num_cells(node);
+		if (batch->num_rows + num_cells > VECTOR_BATCH_SIZE) {
+			break;
+		}
+
+		for (uint32_t i = 0; i < num_cells; i++) {
+			uint32_t row = batch->num_rows + i;
+			batch->ids[row] = key_to_uint64(leaf_node_key(node, i));
+			batch->txns[row] = *leaf_node_txn(node, i);
+			batch->values[row] = leaf_node_value(node, i);
+		}
+		batch->num_rows += num_cells;
+
+		uint32_t next_page_num = *leaf_node_next_leaf(node);
+		if (next_page_num == 0
+				|| (num_cells > 0 && key_to_uint64(leaf_node_key(node, num_cells - 1)) >= scan->high)) {
+			scan->done = true;
+		} else {
+			scan->page_num = next_page_num;
+		}
+	}
+
+	select_visible(batch, scan->snapshot_txn, scan->low, scan->high);
+	select_versions(scan, batch);
+	return batch->num_rows > 0;
+}
+
+void vector_scan_close(VectorScan* scan) {
+	indexed_release_snapshot(scan->table, scan->snapshot_txn);
+}
+
+void vector_filter_text(RowBatch* batch, Column column, CompareOp op, const char* text) {
+	uint32_t offset = (column == COLUMN_USERNAME) ? USERNAME_OFFSET : EMAIL_OFFSET;
+	uint32_t size = (column == COLUMN_USERNAME) ? USERNAME_SIZE : EMAIL_SIZE;
+
+	for (uint32_t i = 0; i < batch->num_rows; i++) {
+		if (!batch->selected[i]) {
+			continue;
+		}
+
+		int compared = strncmp((const char*)batch->values[i] + offset, text, size);
+		switch (op) {
+			case (COMPARE_EQUAL):
+				batch->selected[i] = compared == 0;
+				break;
+			case (COMPARE_LESS):
+				batch->selected[i] = compared < 0;
+				break;
+			case (COMPARE_LESS_EQUAL):
+				batch->selected[i] = compared <= 0;
+				break;
+			case (COMPARE_GREATER):
+				batch->selected[i] = compared > 0;
+				break;
+			case (COMPARE_GREATER_EQUAL):
+				batch->selected[i] = compared >= 0;
+				break;
+		}
+	}
+}
+
+uint32_t vector_count(RowBatch* batch) {
+	uint32_t count = 0;
+	for (uint32_t i = 0; i < batch->num_rows; i++) {
+		count += batch->selected[i];
+	}
+	return count;
+}
+
+uint64_t vector_sum(RowBatch* batch) {
+	uint64_t sum = 0;
+	for (uint32_t i = 0; i < batch->num_rows; i++) {
+		sum += batch->ids[i] * batch->selected[i];
+	}
+	return sum;
+}
+
+/* Batches are in key order, so the first and last selected ids are the extremes. */
+bool vector_first(RowBatch* batch, uint64_t* id) {
+	for (uint32_t i = 0; i < batch->num_rows; i++) {
+		if (batch->selected[i]) {
+			*id = batch->ids[i];
+			return true;
+		}
+	}
+	return false;
+}
+
+bool vector_last(RowBatch* batch, uint64_t* id) {
+	for (uint32_t i = batch->num_rows; i > 0; i--) {
+		if (batch->selected[i - 1]) {
+			*id = batch->ids[i - 1];
+			return true;
+		}
+	}
+	return false;
+}
+
+void vector_project(RowBatch* batch, ResultSink* sink, uint32_t columns) {
+	for (uint32_t i = 0; i < batch->num_rows; i++) {
+		if (batch->selected[i]) {
+			sink_write_columns(sink, batch->values[i], columns);
+		}
+	}
+}
@@ -0,0 +1,79 @@
+#ifndef VECTOR_H
+#define VECTOR_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "table.h"
+#include "sink.h"
+#include "parser.h"
+
+/* Enough for dozens of full leaves per batch. */
+#define VECTOR_BATCH_SIZE 512
+
+/*
+ * Column vectors for a run of consecutive leaf cells. ids and txns are
+ * copied out of the cells so kernels over them are flat loops; values
+ * point at the serialized rows in the pager's pages, or in the version
+ * store for a replaced row the scan's snapshot still sees. selected is the
+ * selection vector: kernels only ever clear entries, and downstream
+ * operators skip rows whose entry is 0.
+*/
+typedef struct {
+	uint32_t num_rows;
+	uint64_t ids[VECTOR_BATCH_SIZE];
+	uint32_t txns[VECTOR_BATCH_SIZE];
+	void* values[VECTOR_BATCH_SIZE];
+	uint8_t selected[VECTOR_BATCH_SIZE];
+} RowBatch;
+
+/*
+ * Reads the leaves holding keys in [low, high] a batch at a time, as of the
+ * transaction current when it was opened, holding that snapshot until
+ * vector_scan_close. Batches point into pages, so a batch must be consumed
+ * before the table is written again.
+ *
+ * An index scan instead walks the run of keys for text in a secondary index
+ * (see index.h) and reads each entry's row from the table. Each of its
+ * batches is sorted by id. last_key is the entry it read last, and the
+ * prefix before the first; like a cursor, it re-seeks there when the leaf
+ * it is on has been rewritten (page_txn no longer matches).
+*/
+typedef struct {
+	Table* table;
+	uint32_t page_num;
+	bool done;
+	uint32_t snapshot_txn;
+	uint64_t low;
+	uint64_t high;
+	bool by_index;
+	Table index;
+	uint32_t cell_num;
+	uint32_t page_txn;
+	Key index_key;
+	Key last_key;
+	Column index_column;
+	const char* index_text;
+} VectorScan;
+
+void vector_scan_open(VectorScan* scan, Table* table, uint64_t low, uint64_t high);
+
+void vector_scan_open_index(VectorScan* scan, Table* table, Column column, const char* text, uint64_t low, uint64_t high);
+
+bool vector_scan_next(VectorScan* scan, RowBatch* batch);
+
+void vector_scan_close(VectorScan* scan);
+
+void vector_filter_text(RowBatch* batch, Column column, CompareOp op, const char* text);
+
+uint32_t vector_count(RowBatch* batch);
+
+uint64_t vector_sum(RowBatch* batch);
+
+bool vector_first(RowBatch* batch, uint64_t* id);
+
+bool vector_last(RowBatch* batch, uint64_t* id);
+
+void vector_project(RowBatch* batch, ResultSink* sink, uint32_t columns);
+
+#endif // VECTOR_H
@@ -0,0 +1,116 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "table.h"
+#include "version.h"
+
+/*
+ * Registers a snapshot as of the last commit and returns its txn, which
+ * the caller hands back to version_release_snapshot.
+*/
+uint32_t version_hold_snapshot(Table* table) {
+	if (table->versions == NULL) {
+		table->versions = calloc(1, sizeof(VersionStore));
+	}
+
+	VersionStore* store = table->versions;
+	if (store->num_snapshots == store->snapshots_capacity) {
+		store->snapshots_capacity = store->snapshots_capacity == 0 ? 4 : store->snapshots_capacity * 2;
+		store->snapshots = realloc(store->snapshots, store->snapshots_capacity * sizeof(uint32_t));
+	}
+	store->snapshots[store->num_snapshots++] = table->txn;
+	return table->txn;
+}
+
+void version_release_snapshot(Table* table, uint32_t snapshot_txn) {
+	VersionStore* store = table->versions;
+	for (uint32_t i = 0; i < store->num_snapshots; i++) {
+		if (store->snapshots[i] == snapshot_txn) {
+			store->snapshots[i] = store->snapshots[--store->num_snapshots];
+			return;
+		}
+	}
+}
+
+bool version_snapshots_held(Table* table) {
+	return table->versions != NULL && table->versions->num_snapshots > 0;
+}
+
+/* Keeps value, written by txn, as the version the current write replaces. */
+void version_add(Table* table, const void* value, uint32_t txn) {
+	VersionStore* store = table->versions;
+	if (store->num_versions == store->versions_capacity) {
+		store->versions_capacity = store->versions_capacity == 0 ? 16 : store->versions_capacity * 2;
+		store->versions = realloc(store->versions, store->versions_capacity * sizeof(RowVersion));
+		store->values = realloc(store->values, (size_t)store->versions_capacity * ROW_SIZE);
+	}
+
+	uint32_t i = store->num_versions++;
+	memcpy(&store->versions[i].id, value + ID_OFFSET, ID_SIZE);
+	store->versions[i].txn = txn;
+	store->versions[i].replaced_txn = table->txn;
+	memcpy(store->values + (size_t)i * ROW_SIZE, value, ROW_SIZE);
+}
+
+/*
+ * The row id had as of snapshot_txn, or NULL if no version of it is kept.
+ * txn, unless NULL, receives the transaction that wrote it.
+*/
+void* version_find(Table* table, uint64_t id, uint32_t snapshot_txn, uint32_t* txn) {
+	VersionStore* store = table->versions;
+	if (store == NULL) {
+		return NULL;
+	}
+
+	for (uint32_t i = 0; i < store->num_versions; i++) {
+		RowVersion* version = &store->versions[i];
+		if (version->id == id && version->txn <= snapshot_txn && snapshot_txn < version->replaced_txn) {
+			if (txn != NULL) {
+				*txn = version->txn;
+			}
+			return store->values + (size_t)i * ROW_SIZE;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Removes one version that every held snapshot is too new to see, copying
+ * its row into row. Returns false once there is none.
+*/
+bool version_take_expired(Table* table, Row* row) {
+	VersionStore* store = table->versions;
+	if (store == NULL) {
+		return false;
+	}
+
+	uint32_t oldest = UINT32_MAX;
+	for (uint32_t i = 0; i < store->num_snapshots; i++) {
+		if (store->snapshots[i] < oldest) {
+			oldest = store->snapshots[i];
+		}
+	}
+
+	for (uint32_t i = 0; i < store->num_versions; i++) {
+		if (store->versions[i].replaced_txn <= oldest) {
+			uint32_t last = --store->num_versions;
+			deserialize_row(store->values + (size_t)i * ROW_SIZE, row);
+			store->versions[i] = store->versions[last];
+			memcpy(store->values + (size_t)i * ROW_SIZE, store->values + (size_t)last * ROW_SIZE, ROW_SIZE);
+			return true;
+		}
+	}
+	return false;
+}
+
+void version_store_free(VersionStore* store) {
+	if (store == NULL) {
+		return;
+	}
+	free(store->versions);
+	free(store->values);
+	free(store->snapshots);
+	free(store);
+}
@@ -0,0 +1,49 @@
+#ifndef VERSION_H
+#define VERSION_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "table.h"
+
+/*
+ * Rows an upsert replaced while a snapshot was held. A leaf keeps only a
+ * row's newest version, stamped with the transaction that wrote it; the
+ * store keeps each older one with the transaction that wrote it and the
+ * one that replaced it, so a snapshot taken in between still reads it.
+ * Snapshots that outlive writes, such as db_scan's, are held with
+ * version_hold_snapshot. Versions are recorded only while one is held and
+ * dropped once no held snapshot can see them.
+*/
+typedef struct {
+	uint64_t id;
+	uint32_t txn;
+	uint32_t replaced_txn;
+} RowVersion;
+
+/* Version i's row is the ROW_SIZE bytes at values + i * ROW_SIZE. */
+struct VersionStore {
+	RowVersion* versions;
+	uint8_t* values;
+	uint32_t num_versions;
+	uint32_t versions_capacity;
+	uint32_t* snapshots;
+	uint32_t num_snapshots;
+	uint32_t snapshots_capacity;
+};
+
+uint32_t version_hold_snapshot(Table* table);
+
+void version_release_snapshot(Table* table, uint32_t snapshot_txn);
+
+bool version_snapshots_held(Table* table);
+
+void version_add(Table* table, const void* value, uint32_t txn);
+
+void* version_find(Table* table, uint64_t id, uint32_t snapshot_txn, uint32_t* txn);
+
+bool version_take_expired(Table* table, Row* row);
+
+void version_store_free(VersionStore* store);
+
+#endif // VERSION_H